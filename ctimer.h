@@ -58,8 +58,36 @@
  * - `ctimer_reset()`   :: reset elapsed time
  * - `ctimer_measure()` :: measure elapsed time between start & stop
  * - `ctimer_lap()`     :: accumulate elapsed time between start & stop
+ * - `ctimer_pause()`   :: stop stopwatch and accumulate elapsed time
+ * - `ctimer_resume()`  :: restart a paused stopwatch
+ * - `ctimer_peek()`    :: elapsed time so far, without stopping
+ * - `ctimer_start_at()`     :: start stopwatch at a given timestamp
+ * - `ctimer_stop_at()`      :: stop stopwatch at a given timestamp
+ * - `ctimer_start_group()`  :: start several stopwatches with one clock read
+ * - `ctimer_stop_group()`   :: stop several stopwatches with one clock read
+ * - `ctimer_stamp()`        :: read clock into the per-thread timestamp
+ * - `ctimer_stamp_last()`   :: reuse the per-thread timestamp
+ * - `ctimer_calibrate()`    :: measure the cost of one clock read
  * - `ctimer_print()`   :: print elapsed time in sec with fixed format
  *
+ * Split stopwatch utilities
+ * - `ctimer_split_t`       :: type of CTimer split stopwatch struct
+ * - `ctimer_split_reset()` :: reset per-phase elapsed times and counts
+ * - `ctimer_split_start()` :: start split stopwatch in a phase
+ * - `ctimer_split_mark()`  :: end current phase and begin the next one
+ * - `ctimer_split_stop()`  :: end current phase and stop split stopwatch
+ * - `ctimer_split_print()` :: print per-phase elapsed times
+ *
+ * Lap statistics utilities
+ * - `ctimer_stats_t`       :: type of lap count/sum/min/max struct
+ * - `ctimer_stats_reset()` :: reset lap statistics
+ * - `ctimer_stats_add()`   :: add one lap duration in nsec
+ * - `ctimer_stats_lap()`   :: add the start-to-end duration of a stopwatch
+ * - `ctimer_stats_add_atomic()` :: add one lap duration to shared statistics
+ * - `ctimer_stats_load()`  :: read shared statistics
+ * - `ctimer_stats_merge()` :: merge two sets of lap statistics
+ * - `ctimer_stats_print()` :: print lap statistics with fixed format
+ *
  * Timespec struct utilities
  * - `timespec_sub()`   :: calculate difference between 2 timespecs
  * - `timespec_add()`   :: calculate sum of 2 timespecs
@@ -68,6 +96,30 @@
  * - `timespec_usec()`  :: timespec tv time in usec (long)
  * - `timespec_nsec()`  :: timespec tv time in nsec (long)
  *
+ * Companion headers (include-only; each one includes `ctimer.h`):
+ * - `ctimer_interval.h` :: union/overlap/exclusive time of labeled intervals
+ * - `ctimer_anchor.h` :: monotonic-to-UTC conversion of timestamps at export
+ * - `ctimer_clockcache.h` :: service-thread cached clock for coarse timestamps
+ * - `ctimer_adaptive.h` :: stopwatches that demote themselves when too costly
+ * - `ctimer_energy.h` :: RAPL joules and watts of timed sections
+ * - `ctimer_shard.h` :: NUMA-local per-thread statistics with per-node reports
+ * - `ctimer_buf.h` :: huge-page-backed, prefaulted buffer allocation
+ * - `ctimer_trace.h` :: per-thread rings of timestamped stopwatch events
+ * - `ctimer_hist.h` :: log-linear latency histograms
+ * - `ctimer_tracewriter.h` :: non-blocking double-buffered trace file writer (io_uring)
+ * - `ctimer_bench.h` :: benchmark harness with fixtures, compensated
+ *   pause/resume, and Google Benchmark-compatible JSON output
+ * - `ctimer_ftrace.h` :: ftrace trace_marker events for stopwatch starts and stops
+ * - `ctimer_usdt.h` :: USDT probes at stopwatch start, stop, and lap for bpftrace/perf
+ * - `ctimer_latency.h` :: open-loop latency recording with coordinated-omission correction
+ * - `ctimer_loadgen.h` :: open-loop load generator with rate sweeps and saturation knee
+ * - `ctimer_tags.h` :: label-plus-tags statistics in a lock-free fixed-capacity table
+ * - `ctimer_registry.h` :: concurrent string-keyed registry of named statistics
+ * - `ctimer_scope.h` :: per-thread scope stacks and call-tree profiles
+ * - `ctimer_sampler.h` :: CPU-time sampling profiler attributing samples to the active scope
+ * - `ctimer_causal.h` :: causal profiling by virtual speedups of instrumented regions
+ * - `ctimer_ewma.h` :: EWMA mean/variance and time-decayed rate with lock-free reads
+ *
  * @section usage Using CTimer
  *
  * @subsection c_std C standard
@@ -85,7 +137,43 @@
  * The `elapsed` timespec of a `ctimer_t` stopwatch can be reset to 0 using the
  * `ctimer_reset()` function.  This is not necessary if timings are only
  * measured using `ctimer_measure()`, but it *is* necessary before using
- * `ctimer_lap()` with an otherwise un-measured stopwatch.
+ * `ctimer_lap()`, `ctimer_pause()`, or `ctimer_peek()` with an otherwise
+ * un-measured stopwatch.
+ *
+ * @subsection pause Pausing and resuming
+ *
+ * A `ctimer_t` stopwatch is running between `ctimer_start()` (or
+ * `ctimer_resume()`) and `ctimer_stop()` (or `ctimer_pause()`).
+ * `ctimer_pause()` reads the clock once, adds the time since the last
+ * start/resume to `elapsed`, and counts a lap; it is equivalent to
+ * `ctimer_stop()` followed by `ctimer_lap()`.  `ctimer_resume()` reads the
+ * clock once and restarts the stopwatch without touching `elapsed`.
+ * `ctimer_peek()` returns the accumulated time including the current,
+ * in-progress lap of a running stopwatch.
+ *
+ * @subsection shared_stamps Sharing clock reads
+ *
+ * Stopwatches that start or stop at the same point of a program can share a
+ * single clock read: `ctimer_start_group()` and `ctimer_stop_group()` apply
+ * one timestamp to an array of stopwatches, and `ctimer_start_at()` and
+ * `ctimer_stop_at()` apply a caller-provided timestamp to one stopwatch.
+ * `ctimer_stamp()` reads the clock into a per-thread timestamp which nested
+ * instrumentation within a short section can reuse via `ctimer_stamp_last()`.
+ * The per-thread timestamp is a weak thread-local symbol, shared by all
+ * translation units of a program (requires GCC or Clang).
+ *
+ * @subsection ftrace Kernel trace markers
+ *
+ * If the preprocessor macro `CTIMER_FTRACE` is defined, then stopwatch
+ * start/resume and stop/pause events also write ftrace `trace_marker` events
+ * while markers are enabled at runtime (off by default); see
+ * `ctimer_ftrace.h`.
+ *
+ * @subsection usdt Static tracing probes
+ *
+ * If the preprocessor macro `CTIMER_USDT` is defined, then stopwatch start,
+ * stop, and lap events contain USDT probe points (provider `ctimer`) for
+ * bpftrace, perf, or SystemTap; see `ctimer_usdt.h`.
  *
  * @subsection measure_on_stop Automatic elapsed-time measurement on stop
  *
@@ -107,6 +195,13 @@
 #include <unistd.h>
 #include <stdio.h>
 
+#ifdef CTIMER_FTRACE
+#include "ctimer_ftrace.h"
+#endif
+#ifdef CTIMER_USDT
+#include "ctimer_usdt.h"
+#endif
+
 
 /**
  * @defgroup ctimer CTimer
@@ -266,6 +361,26 @@ long timespec_nsec(
 }
 
 
+/* t_acc += t_end - t_start, with a single normalization step; all of t_acc
+ * and (t_end - t_start) are assumed to be non-negative */
+static inline
+void _timespec_accum(
+    struct timespec       * t_acc,
+    struct timespec const   t_end,
+    struct timespec const   t_start
+) {
+    t_acc->tv_nsec += t_end.tv_nsec - t_start.tv_nsec;
+    t_acc->tv_sec  += t_end.tv_sec  - t_start.tv_sec;
+    if (t_acc->tv_nsec < 0) {
+        t_acc->tv_nsec += _NSEC_PER_SEC;
+        t_acc->tv_sec--;
+    } else if (t_acc->tv_nsec >= _NSEC_PER_SEC) {
+        t_acc->tv_nsec -= _NSEC_PER_SEC;
+        t_acc->tv_sec++;
+    }
+}
+
+
 /** @} */ /* end group ctimer_timespec */
 
 
@@ -290,9 +405,43 @@ typedef struct {
     struct timespec start;      /**< Stopwatch start time  */
     struct timespec end;        /**< Stopwatch end time */
     struct timespec elapsed;    /**< Elapsed/measured time */
+    unsigned long   laps;       /**< Number of laps accumulated in `elapsed` */
+    int             running;    /**< Nonzero while started/resumed */
 } ctimer_t;
 
 
+/* tracing hooks on stopwatch start/stop/lap events; no-ops unless enabled at
+ * compile time (see `ctimer_ftrace.h` and `ctimer_usdt.h`) */
+#ifdef CTIMER_FTRACE
+#define _CTIMER_FTRACE_HOOK(k, t, ts) ctimer_ftrace_emit((k), (t), (ts))
+#else
+#define _CTIMER_FTRACE_HOOK(k, t, ts) ((void)0)
+#endif
+
+#ifdef CTIMER_USDT
+#define _CTIMER_USDT_HOOK(name, t, ts)                          \
+    CTIMER_USDT_PROBE2(name, (t), timespec_nsec(ts))
+#define _CTIMER_USDT_HOOK_LAP(t)                                        \
+    CTIMER_USDT_PROBE3(lap, (t), timespec_nsec((t)->end),               \
+                       timespec_nsec((t)->end) - timespec_nsec((t)->start))
+#else
+#define _CTIMER_USDT_HOOK(name, t, ts) ((void)0)
+#define _CTIMER_USDT_HOOK_LAP(t) ((void)0)
+#endif
+
+#define _CTIMER_HOOK_START(t)                           \
+    do {                                                \
+        _CTIMER_FTRACE_HOOK('S', (t), (t)->start);      \
+        _CTIMER_USDT_HOOK(start, (t), (t)->start);      \
+    } while (0)
+#define _CTIMER_HOOK_STOP(t)                            \
+    do {                                                \
+        _CTIMER_FTRACE_HOOK('E', (t), (t)->end);        \
+        _CTIMER_USDT_HOOK(stop, (t), (t)->end);         \
+    } while (0)
+#define _CTIMER_HOOK_LAP(t) _CTIMER_USDT_HOOK_LAP(t)
+
+
 /**
  * Measure elapsed time of `ctimer_t` stopwatch in s+ns and *store* it in the
  * `elapsed` timer.
@@ -342,21 +491,26 @@ void ctimer_lap(
     ctimer_t * t                /**<[in,out] stopwatch pointer */
 ) {
     /* elapsed += end - start */
-    timespec_add(&t->elapsed, t->elapsed, t->end);
-    timespec_sub(&t->elapsed, t->elapsed, t->start);
+    _timespec_accum(&t->elapsed, t->end, t->start);
+    t->laps++;
+    _CTIMER_HOOK_LAP(t);
 }
 
 
 /**
- * Zero out the `elapsed` timer of a `ctimer_t` stopwatch.
+ * Zero out the `elapsed` timer and lap count of a `ctimer_t` stopwatch, and
+ * mark it as not running.
  *
  * @sa ctimer_lap
+ * @sa ctimer_pause
  */
 static inline
 void ctimer_reset(
     ctimer_t * t                /**<[in,out] stopwatch pointer */
 ) {
     t->elapsed = (struct timespec){0};
+    t->laps    = 0;
+    t->running = 0;
 }
 
 
@@ -372,6 +526,8 @@ void ctimer_start(
     ctimer_t * t                /**<[in,out] stopwatch pointer */
 ) {
     clock_gettime(CLOCK_MONOTONIC, &t->start);
+    t->running = 1;
+    _CTIMER_HOOK_START(t);
 }
 
 
@@ -392,12 +548,225 @@ void ctimer_stop(
     ctimer_t * t                /**<[in,out] stopwatch pointer */
 ) {
     clock_gettime(CLOCK_MONOTONIC, &t->end);
+    t->running = 0;
+    _CTIMER_HOOK_STOP(t);
 #ifdef CTIMER_MEASURE_ON_STOP
     ctimer_measure(t);
 #endif
 }
 
 
+/**
+ * Pause a running `ctimer_t` stopwatch: set its `end` timer and add the time
+ * since the last start/resume to `elapsed`.  Reads the clock once.  Has no
+ * effect if the stopwatch is not running.
+ *
+ * @note `ctimer_pause()` is equivalent to `ctimer_stop()` followed by
+ * `ctimer_lap()` (regardless of `CTIMER_MEASURE_ON_STOP`); do not call
+ * `ctimer_lap()` again after pausing.
+ *
+ * @warning The `elapsed` field must be initialized (e.g. with
+ * `ctimer_reset()`) before the first pause.
+ *
+ * @sa ctimer_resume
+ * @sa ctimer_peek
+ */
+static inline
+void ctimer_pause(
+    ctimer_t * t                /**<[in,out] stopwatch pointer */
+) {
+    if (!t->running)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &t->end);
+    _timespec_accum(&t->elapsed, t->end, t->start);
+    t->laps++;
+    t->running = 0;
+    _CTIMER_HOOK_STOP(t);
+    _CTIMER_HOOK_LAP(t);
+}
+
+
+/**
+ * Resume a paused `ctimer_t` stopwatch: set its `start` timer without
+ * touching `elapsed`.  Reads the clock once.  Has no effect if the stopwatch
+ * is already running.
+ *
+ * @sa ctimer_pause
+ */
+static inline
+void ctimer_resume(
+    ctimer_t * t                /**<[in,out] stopwatch pointer */
+) {
+    if (t->running)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &t->start);
+    t->running = 1;
+    _CTIMER_HOOK_START(t);
+}
+
+
+/**
+ * Return the accumulated `elapsed` time of a `ctimer_t` stopwatch plus, if
+ * the stopwatch is running, the time since its last start/resume.  The
+ * stopwatch is not modified.  Reads the clock only if the stopwatch is
+ * running.
+ *
+ * @sa ctimer_pause
+ * @sa ctimer_resume
+ */
+static inline
+struct timespec ctimer_peek(
+    ctimer_t const * t          /**<[in] stopwatch pointer */
+) {
+    struct timespec live = t->elapsed;
+    if (t->running) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        _timespec_accum(&live, now, t->start);
+    }
+    return live;
+}
+
+
+/**
+ * Start a `ctimer_t` stopwatch at timestamp `ts` (e.g., from `ctimer_stamp()`)
+ * instead of reading the clock.
+ *
+ * @sa ctimer_start
+ * @sa ctimer_start_group
+ */
+static inline
+void ctimer_start_at(
+    ctimer_t              * t,  /**<[in,out] stopwatch pointer */
+    struct timespec const   ts  /**<[in]     start timestamp */
+) {
+    t->start   = ts;
+    t->running = 1;
+    _CTIMER_HOOK_START(t);
+}
+
+
+/**
+ * Stop a `ctimer_t` stopwatch at timestamp `ts` (e.g., from `ctimer_stamp()`)
+ * instead of reading the clock.  Honors `CTIMER_MEASURE_ON_STOP`.
+ *
+ * @sa ctimer_stop
+ * @sa ctimer_stop_group
+ */
+static inline
+void ctimer_stop_at(
+    ctimer_t              * t,  /**<[in,out] stopwatch pointer */
+    struct timespec const   ts  /**<[in]     stop timestamp */
+) {
+    t->end     = ts;
+    t->running = 0;
+    _CTIMER_HOOK_STOP(t);
+#ifdef CTIMER_MEASURE_ON_STOP
+    ctimer_measure(t);
+#endif
+}
+
+
+/**
+ * Start `n` `ctimer_t` stopwatches at the same instant, with a single clock
+ * read.
+ *
+ * @sa ctimer_stop_group
+ */
+static inline
+void ctimer_start_group(
+    ctimer_t * const * ts,      /**<[in,out] stopwatch pointers */
+    int        const   n        /**<[in]     number of stopwatches */
+) {
+    struct timespec now;
+    int             i;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < n; ++i)
+        ctimer_start_at(ts[i], now);
+}
+
+
+/**
+ * Stop `n` `ctimer_t` stopwatches at the same instant, with a single clock
+ * read.
+ *
+ * @sa ctimer_start_group
+ */
+static inline
+void ctimer_stop_group(
+    ctimer_t * const * ts,      /**<[in,out] stopwatch pointers */
+    int        const   n        /**<[in]     number of stopwatches */
+) {
+    struct timespec now;
+    int             i;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < n; ++i)
+        ctimer_stop_at(ts[i], now);
+}
+
+
+/* per-thread reusable timestamp; weak, so all translation units share one */
+__attribute__((weak)) __thread struct timespec _ctimer_stamp;
+
+
+/**
+ * Read the clock into the calling thread's reusable timestamp and return it.
+ *
+ * @sa ctimer_stamp_last
+ */
+static inline
+struct timespec ctimer_stamp(void) {
+    clock_gettime(CLOCK_MONOTONIC, &_ctimer_stamp);
+    return _ctimer_stamp;
+}
+
+
+/**
+ * Return the calling thread's timestamp from its last `ctimer_stamp()` call,
+ * without reading the clock.
+ *
+ * @warning The returned timestamp is only as fresh as the last
+ * `ctimer_stamp()` call on the calling thread; reuse it only within short
+ * sections where that staleness is acceptable.
+ *
+ * @sa ctimer_stamp
+ */
+static inline
+struct timespec ctimer_stamp_last(void) {
+    return _ctimer_stamp;
+}
+
+
+/**
+ * Measure the mean cost of one `clock_gettime(CLOCK_MONOTONIC)` call in nsec,
+ * as the minimum over 5 batches of `n` back-to-back calls.
+ *
+ * @note Each `ctimer_start()`/`ctimer_stop()` pair costs two clock reads.
+ *
+ * @return mean nsec per clock read (at least 1)
+ */
+static inline
+long ctimer_calibrate(
+    int const n                 /**<[in] clock reads per batch */
+) {
+    long best = -1;
+    int  rep;
+    for (rep = 0; rep < 5; ++rep) {
+        struct timespec t0, t1, tmp;
+        long            per;
+        int             i;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < n; ++i)
+            clock_gettime(CLOCK_MONOTONIC, &tmp);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        per = (timespec_nsec(t1) - timespec_nsec(t0)) / (n > 0 ? n + 1 : 1);
+        if ((best < 0) || (per < best))
+            best = per;
+    }
+    return (best > 0) ? best : 1;
+}
+
+
 /**
  * Print a line with the `elapsed` time of a `ctimer_t` stopwatch in seconds.
  *
@@ -433,6 +802,331 @@ void ctimer_print(
 /** @} */ /* end group ctimer_stopwatch */
 
 
+/* ==================================================
+ * SPLIT STOPWATCH API
+ * ================================================== */
+
+
+/**
+ * @defgroup ctimer_split Split stopwatch API
+ *
+ * Functions for timing sequences of phases with one clock read per phase
+ * boundary.
+ *
+ * A `ctimer_split_t` split stopwatch keeps one timestamp (the last
+ * checkpoint) and per-phase accumulators.  Each call to `ctimer_split_mark()`
+ * reads the clock once, attributes the interval since the previous checkpoint
+ * to the current phase, and makes the given phase current.  Phases are small
+ * integer ids in `[0, CTIMER_SPLIT_MAX_PHASES)`, used directly as array
+ * indices.
+ *
+ * @{
+ */
+
+
+/**
+ * Number of phase slots in a `ctimer_split_t` split stopwatch.  May be
+ * overridden before including `ctimer.h`.
+ */
+#ifndef CTIMER_SPLIT_MAX_PHASES
+#define CTIMER_SPLIT_MAX_PHASES 16
+#endif
+
+
+/**
+ * Split stopwatch struct using `clock_gettime()`.
+ */
+typedef struct {
+    struct timespec mark;       /**< Time of last checkpoint */
+    int             phase;      /**< Current phase id; -1 if stopped */
+    struct timespec elapsed[CTIMER_SPLIT_MAX_PHASES]; /**< Per-phase time */
+    unsigned long   count[CTIMER_SPLIT_MAX_PHASES];   /**< Per-phase laps */
+} ctimer_split_t;
+
+
+/**
+ * Zero out the per-phase `elapsed` timers and `count` lap counters of a
+ * `ctimer_split_t` split stopwatch, and mark it as stopped.
+ */
+static inline
+void ctimer_split_reset(
+    ctimer_split_t * s          /**<[in,out] split stopwatch pointer */
+) {
+    int i;
+    for (i = 0; i < CTIMER_SPLIT_MAX_PHASES; ++i) {
+        s->elapsed[i] = (struct timespec){0};
+        s->count[i]   = 0;
+    }
+    s->phase = -1;
+}
+
+
+/**
+ * Start a `ctimer_split_t` split stopwatch in phase `phase`.  Sets the `mark`
+ * timer of the split stopwatch.
+ *
+ * @warning `phase` must lie in `[0, CTIMER_SPLIT_MAX_PHASES)`; it is not
+ * checked.
+ *
+ * @sa ctimer_split_mark
+ * @sa ctimer_split_stop
+ */
+static inline
+void ctimer_split_start(
+    ctimer_split_t * s,         /**<[in,out] split stopwatch pointer */
+    int const        phase      /**<[in]     first phase id */
+) {
+    clock_gettime(CLOCK_MONOTONIC, &s->mark);
+    s->phase = phase;
+}
+
+
+/**
+ * Checkpoint a running `ctimer_split_t` split stopwatch: add the time since
+ * the last checkpoint to the current phase, and continue in phase `next`.
+ * Reads the clock once.
+ *
+ * @warning The split stopwatch must be started, and `next` must lie in
+ * `[0, CTIMER_SPLIT_MAX_PHASES)`; neither is checked.
+ *
+ * @sa ctimer_split_start
+ * @sa ctimer_split_stop
+ */
+static inline
+void ctimer_split_mark(
+    ctimer_split_t * s,         /**<[in,out] split stopwatch pointer */
+    int const        next       /**<[in]     next phase id */
+) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    _timespec_accum(&s->elapsed[s->phase], now, s->mark);
+    s->count[s->phase]++;
+    s->mark  = now;
+    s->phase = next;
+}
+
+
+/**
+ * Stop a running `ctimer_split_t` split stopwatch: add the time since the last
+ * checkpoint to the current phase.  Reads the clock once.
+ *
+ * @sa ctimer_split_start
+ * @sa ctimer_split_mark
+ */
+static inline
+void ctimer_split_stop(
+    ctimer_split_t * s          /**<[in,out] split stopwatch pointer */
+) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    _timespec_accum(&s->elapsed[s->phase], now, s->mark);
+    s->count[s->phase]++;
+    s->mark  = now;
+    s->phase = -1;
+}
+
+
+/**
+ * Print one line per visited phase of a `ctimer_split_t` split stopwatch,
+ * with its accumulated `elapsed` time in seconds and lap count.
+ *
+ * Lines are printed as:
+ * ```
+ * Time(<label>) = XX.XXXXXXXXX sec [N laps]
+ * ```
+ *
+ * If `labels` is `NULL` or `labels[i]` is `NULL`, phase `i` is labeled by its
+ * id.  Phases with a zero lap count are skipped.
+ *
+ * @sa ctimer_print
+ */
+static inline
+void ctimer_split_print(
+    ctimer_split_t const         * s,      /**<[in] split stopwatch pointer */
+    char           const * const * labels, /**<[in] per-phase labels or NULL */
+    int                    const   n       /**<[in] number of phases to print */
+) {
+    int i;
+    for (i = 0; (i < n) && (i < CTIMER_SPLIT_MAX_PHASES); ++i) {
+        if (s->count[i] == 0)
+            continue;
+        if ((labels != NULL) && (labels[i] != NULL))
+            printf("Time(%s) = ", labels[i]);
+        else
+            printf("Time(phase %d) = ", i);
+        printf("%ld.%09ld sec [%lu laps]\n",
+               (long)s->elapsed[i].tv_sec, s->elapsed[i].tv_nsec, s->count[i]);
+    }
+}
+
+
+/** @} */ /* end group ctimer_split */
+
+
+/* ==================================================
+ * LAP STATISTICS API
+ * ================================================== */
+
+
+/**
+ * @defgroup ctimer_stats Lap statistics API
+ *
+ * Functions for aggregating lap durations (count, sum, min, max).
+ *
+ * @{
+ */
+
+
+/**
+ * Lap statistics struct.  All durations are in nsec.
+ */
+typedef struct {
+    unsigned long count;        /**< Number of laps */
+    long          sum;          /**< Total duration */
+    long          min;          /**< Shortest lap; -1 if no laps */
+    long          max;          /**< Longest lap */
+} ctimer_stats_t;
+
+
+/**
+ * Reset lap statistics to zero laps.
+ */
+static inline
+void ctimer_stats_reset(
+    ctimer_stats_t * s          /**<[out] lap statistics */
+) {
+    s->count = 0;
+    s->sum   = 0;
+    s->min   = -1;
+    s->max   = 0;
+}
+
+
+/**
+ * Add one lap of duration `ns` nsec to lap statistics.
+ */
+static inline
+void ctimer_stats_add(
+    ctimer_stats_t * s,         /**<[in,out] lap statistics */
+    long const       ns         /**<[in]     lap duration (nsec) */
+) {
+    s->count++;
+    s->sum += ns;
+    if ((s->min < 0) || (ns < s->min))
+        s->min = ns;
+    if (ns > s->max)
+        s->max = ns;
+}
+
+
+/**
+ * Add the `start`-to-`end` duration of a stopped `ctimer_t` stopwatch to lap
+ * statistics.
+ */
+static inline
+void ctimer_stats_lap(
+    ctimer_stats_t       * s,   /**<[in,out] lap statistics */
+    ctimer_t       const * t    /**<[in]     stopped stopwatch */
+) {
+    ctimer_stats_add(s, timespec_nsec(t->end) - timespec_nsec(t->start));
+}
+
+
+/**
+ * Add one lap of duration `ns` nsec to lap statistics shared between threads,
+ * using relaxed atomic operations.
+ *
+ * @sa ctimer_stats_load
+ */
+static inline
+void ctimer_stats_add_atomic(
+    ctimer_stats_t * s,         /**<[in,out] lap statistics */
+    long const       ns         /**<[in]     lap duration (nsec) */
+) {
+    long v;
+    __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->sum, ns, __ATOMIC_RELAXED);
+    v = __atomic_load_n(&s->min, __ATOMIC_RELAXED);
+    while (((v < 0) || (ns < v))
+           && !__atomic_compare_exchange_n(&s->min, &v, ns, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    v = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+    while ((ns > v)
+           && !__atomic_compare_exchange_n(&s->max, &v, ns, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+
+/**
+ * Return a copy of lap statistics that other threads may be updating with
+ * `ctimer_stats_add_atomic()`.  Each field is read atomically, though not all
+ * fields at the same instant.
+ */
+static inline
+ctimer_stats_t ctimer_stats_load(
+    ctimer_stats_t const * s    /**<[in] lap statistics */
+) {
+    ctimer_stats_t snap;
+    snap.count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+    snap.sum   = __atomic_load_n(&s->sum,   __ATOMIC_RELAXED);
+    snap.min   = __atomic_load_n(&s->min,   __ATOMIC_RELAXED);
+    snap.max   = __atomic_load_n(&s->max,   __ATOMIC_RELAXED);
+    return snap;
+}
+
+
+/**
+ * Merge lap statistics `src` into `dst`.
+ */
+static inline
+void ctimer_stats_merge(
+    ctimer_stats_t       * dst, /**<[in,out] lap statistics */
+    ctimer_stats_t const * src  /**<[in]     lap statistics */
+) {
+    if (src->count == 0)
+        return;
+    dst->count += src->count;
+    dst->sum   += src->sum;
+    if ((dst->min < 0) || ((src->min >= 0) && (src->min < dst->min)))
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+
+/**
+ * Print a line with the total time in seconds and the lap count and
+ * min/mean/max lap duration of lap statistics.
+ *
+ * The line is printed as:
+ * ```
+ * Time(<label>) = XX.XXXXXXXXX sec [N laps; min/mean/max = A/B/C nsec]
+ * ```
+ *
+ * @sa ctimer_print
+ */
+static inline
+void ctimer_stats_print(
+    ctimer_stats_t const * s,     /**<[in] lap statistics */
+    char           const * label  /**<[in] label/description */
+) {
+    if ((label != NULL) && (label[0] != '\0'))
+        printf("Time(%s) = ", label);
+    else
+        printf("Time = ");
+
+    printf("%ld.%09ld sec [%lu laps; min/mean/max = %ld/%ld/%ld nsec]\n",
+           s->sum / _NSEC_PER_SEC, s->sum % _NSEC_PER_SEC, s->count,
+           (s->min < 0) ? 0 : s->min,
+           (s->count > 0) ? s->sum / (long)s->count : 0, s->max);
+}
+
+
+/** @} */ /* end group ctimer_stats */
+
+
 #ifdef __cplusplus
 } /* end extern "C" */
 #endif
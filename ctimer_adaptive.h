@@ -0,0 +1,349 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Adaptive CTimer stopwatches that demote themselves when their clock overhead
+ * exceeds a budget.
+ *
+ * @file        ctimer_adaptive.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_ADAPTIVE__
+#define __H_CTIMER_ADAPTIVE__
+
+
+#include <stdio.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_adaptive Adaptive stopwatch API
+ * @ingroup ctimer
+ *
+ * Stopwatches that switch to sampled or disabled mode when they wrap intervals
+ * too short to be worth timing.
+ *
+ * A `ctimer_adaptive_t` stopwatch starts fully enabled.  After a warm-up
+ * number of laps, it compares its mean lap time against the calibrated clock
+ * overhead of one lap (two clock reads, see `ctimer_calibrate()`).  If the
+ * overhead-to-interval ratio exceeds the policy's `sample_ratio`, the stopwatch
+ * is demoted to sampled mode (timing one in every 2^`sample_shift` laps); if it
+ * exceeds `disable_ratio`, the stopwatch is disabled.  The hot path checks a
+ * one-byte `mode` flag.
+ *
+ * `ctimer_adaptive_print()` reports the elapsed time (scaled up for sampled
+ * laps), and `ctimer_adaptive_report()` lists demoted stopwatches with the
+ * measurements that triggered the demotion.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Adaptive stopwatch modes.
+ */
+enum {
+    CTIMER_ADAPTIVE_ON      = 0, /**< Every lap is timed */
+    CTIMER_ADAPTIVE_SAMPLED = 1, /**< One in 2^`sample_shift` laps is timed */
+    CTIMER_ADAPTIVE_OFF     = 2  /**< No laps are timed */
+};
+
+
+/**
+ * Adaptive stopwatch demotion policy.  One policy may be shared by many
+ * stopwatches.
+ *
+ * @sa ctimer_adaptive_policy_init
+ */
+typedef struct {
+    long          overhead;      /**< Clock overhead per lap (nsec) */
+    double        sample_ratio;  /**< Overhead/mean ratio to start sampling */
+    double        disable_ratio; /**< Overhead/mean ratio to disable */
+    unsigned long warmup;        /**< Laps before deciding (0 acts as 1) */
+    unsigned      sample_shift;  /**< Sample one in 2^`sample_shift` laps */
+} ctimer_adaptive_policy_t;
+
+
+/**
+ * Adaptive stopwatch struct.
+ */
+typedef struct {
+    ctimer_t                         t;      /**< Underlying stopwatch */
+    unsigned char                    mode;   /**< `CTIMER_ADAPTIVE_*` mode */
+    unsigned long                    calls;  /**< Start calls since demotion */
+    unsigned long                    mask;   /**< Sampling mask */
+    char                     const * label;  /**< Stopwatch label */
+    ctimer_adaptive_policy_t const * policy; /**< Demotion policy */
+    long                             mean;   /**< Mean lap (nsec) at decision */
+    double                           ratio;  /**< Overhead/mean at decision */
+    struct timespec                  full;   /**< Elapsed time at decision */
+    unsigned long                    full_laps; /**< Laps at decision */
+} ctimer_adaptive_t;
+
+
+/**
+ * Initialize a demotion policy with default thresholds: sample when the clock
+ * overhead exceeds 5% of the mean lap, disable when it exceeds the mean lap,
+ * decide after 1000 laps, and sample one in 64 laps.  The clock overhead is
+ * calibrated with `ctimer_calibrate()`.
+ */
+static inline
+void ctimer_adaptive_policy_init(
+    ctimer_adaptive_policy_t * p /**<[out] demotion policy */
+) {
+    p->overhead      = 2 * ctimer_calibrate(1000);
+    p->sample_ratio  = 0.05;
+    p->disable_ratio = 1.0;
+    p->warmup        = 1000;
+    p->sample_shift  = 6;
+}
+
+
+/**
+ * Initialize an adaptive stopwatch in `CTIMER_ADAPTIVE_ON` mode.
+ */
+static inline
+void ctimer_adaptive_init(
+    ctimer_adaptive_t              * a,     /**<[out] adaptive stopwatch */
+    char                     const * label, /**<[in]  stopwatch label */
+    ctimer_adaptive_policy_t const * p      /**<[in]  demotion policy */
+) {
+    ctimer_reset(&a->t);
+    a->mode      = CTIMER_ADAPTIVE_ON;
+    a->calls     = 0;
+    a->mask      = 0;
+    a->label     = label;
+    a->policy    = p;
+    a->mean      = 0;
+    a->ratio     = 0;
+    a->full      = (struct timespec){0};
+    a->full_laps = 0;
+}
+
+
+/* decide on demotion after the warm-up laps */
+static inline
+void _ctimer_adaptive_decide(
+    ctimer_adaptive_t * a
+) {
+    ctimer_adaptive_policy_t const * p = a->policy;
+    long const mean = timespec_nsec(a->t.elapsed) / (long)a->t.laps;
+
+    a->mean      = mean;
+    a->ratio     = (double)p->overhead / (double)(mean > 0 ? mean : 1);
+    a->full      = a->t.elapsed;
+    a->full_laps = a->t.laps;
+    if (a->ratio > p->disable_ratio) {
+        a->mode = CTIMER_ADAPTIVE_OFF;
+    } else if (a->ratio > p->sample_ratio) {
+        a->mask = (1UL << p->sample_shift) - 1;
+        a->mode = CTIMER_ADAPTIVE_SAMPLED;
+    }
+}
+
+
+/**
+ * Start a lap of an adaptive stopwatch, unless the lap is skipped by its mode.
+ *
+ * @sa ctimer_adaptive_stop
+ */
+static inline
+void ctimer_adaptive_start(
+    ctimer_adaptive_t * a       /**<[in,out] adaptive stopwatch */
+) {
+    if (__builtin_expect(a->mode != CTIMER_ADAPTIVE_ON, 0)) {
+        if (a->mode == CTIMER_ADAPTIVE_OFF)
+            return;
+        if ((a->calls++ & a->mask) != 0)
+            return;
+    }
+    ctimer_start(&a->t);
+}
+
+
+/**
+ * Stop a lap of an adaptive stopwatch and accumulate it, if the lap was
+ * started.  Evaluates the demotion policy once, when the warm-up laps are
+ * complete (after the first lap if the policy's `warmup` is 0).
+ *
+ * @sa ctimer_adaptive_start
+ */
+static inline
+void ctimer_adaptive_stop(
+    ctimer_adaptive_t * a       /**<[in,out] adaptive stopwatch */
+) {
+    if (!a->t.running)
+        return;
+    ctimer_pause(&a->t);
+    /* full_laps is 0 until the decision (which sees at least one lap) */
+    if (__builtin_expect((a->mode == CTIMER_ADAPTIVE_ON)
+                         && (a->full_laps == 0)
+                         && (a->t.laps >= a->policy->warmup), 0))
+        _ctimer_adaptive_decide(a);
+}
+
+
+/**
+ * Return the estimated total elapsed time of an adaptive stopwatch: laps timed
+ * in sampled mode are scaled by the sampling rate.  Laps skipped while
+ * disabled are not accounted for.
+ */
+static inline
+struct timespec ctimer_adaptive_estimate(
+    ctimer_adaptive_t const * a /**<[in] adaptive stopwatch */
+) {
+    struct timespec est;
+    long            ns;
+
+    if (a->mode != CTIMER_ADAPTIVE_SAMPLED)
+        return a->t.elapsed;
+    ns = timespec_nsec(a->full)
+        + (timespec_nsec(a->t.elapsed) - timespec_nsec(a->full))
+        * (long)(a->mask + 1);
+    est.tv_sec  = ns / _NSEC_PER_SEC;
+    est.tv_nsec = ns % _NSEC_PER_SEC;
+    return est;
+}
+
+
+/**
+ * Return the estimated number of laps of an adaptive stopwatch: laps in
+ * sampled mode are scaled by the sampling rate.  Laps skipped while disabled
+ * are not accounted for.
+ */
+static inline
+unsigned long ctimer_adaptive_laps(
+    ctimer_adaptive_t const * a /**<[in] adaptive stopwatch */
+) {
+    if (a->mode != CTIMER_ADAPTIVE_SAMPLED)
+        return a->t.laps;
+    return a->full_laps + (a->t.laps - a->full_laps) * (a->mask + 1);
+}
+
+
+/* print the reason for a demotion, without a trailing newline */
+static inline
+void _ctimer_adaptive_print_reason(
+    ctimer_adaptive_t const * a
+) {
+    ctimer_adaptive_policy_t const * p = a->policy;
+    if (a->mode == CTIMER_ADAPTIVE_OFF)
+        printf("disabled");
+    else
+        printf("sampled 1/%lu", a->mask + 1);
+    printf(" after %lu laps: mean %ld nsec/lap, overhead %ld nsec/lap"
+           " (ratio %.3f > %.3f)",
+           a->full_laps, a->mean, p->overhead, a->ratio,
+           (a->mode == CTIMER_ADAPTIVE_OFF) ? p->disable_ratio
+                                            : p->sample_ratio);
+}
+
+
+/**
+ * Print a line with the estimated elapsed time and lap count of an adaptive
+ * stopwatch, and its demotion status.
+ *
+ * The line is printed as:
+ * ```
+ * Time(<label>) = XX.XXXXXXXXX sec [N laps]
+ * Time(<label>) = XX.XXXXXXXXX sec [N laps; sampled 1/64 after ...]
+ * ```
+ *
+ * @sa ctimer_print
+ * @sa ctimer_adaptive_estimate
+ */
+static inline
+void ctimer_adaptive_print(
+    ctimer_adaptive_t const * a /**<[in] adaptive stopwatch */
+) {
+    struct timespec const est = ctimer_adaptive_estimate(a);
+
+    if ((a->label != NULL) && (a->label[0] != '\0'))
+        printf("Time(%s) = ", a->label);
+    else
+        printf("Time = ");
+    printf("%ld.%09ld sec [%lu laps", (long)est.tv_sec, est.tv_nsec,
+           ctimer_adaptive_laps(a));
+    if (a->mode != CTIMER_ADAPTIVE_ON) {
+        printf("; ");
+        _ctimer_adaptive_print_reason(a);
+    }
+    printf("]\n");
+}
+
+
+/**
+ * Print one line per demoted stopwatch among `n` adaptive stopwatches, with
+ * the measurements that triggered the demotion.
+ *
+ * Lines are printed as:
+ * ```
+ * Demoted(<label>): sampled 1/64 after N laps: mean M nsec/lap, ...
+ * ```
+ *
+ * @return number of demoted stopwatches
+ */
+static inline
+int ctimer_adaptive_report(
+    ctimer_adaptive_t const * const * as, /**<[in] adaptive stopwatches */
+    int                       const   n   /**<[in] number of stopwatches */
+) {
+    int demoted = 0;
+    int i;
+    for (i = 0; i < n; ++i) {
+        if (as[i]->mode == CTIMER_ADAPTIVE_ON)
+            continue;
+        printf("Demoted(%s): ", (as[i]->label != NULL) ? as[i]->label : "");
+        _ctimer_adaptive_print_reason(as[i]);
+        printf("\n");
+        demoted++;
+    }
+    return demoted;
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_adaptive */
+
+
+#endif  /* __H_CTIMER_ADAPTIVE__ */
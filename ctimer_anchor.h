@@ -0,0 +1,260 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Wall-clock anchoring of `CLOCK_MONOTONIC` CTimer timestamps.
+ *
+ * @file        ctimer_anchor.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_ANCHOR__
+#define __H_CTIMER_ANCHOR__
+
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_anchor Wall-clock anchor API
+ * @ingroup ctimer
+ *
+ * Conversion of recorded `CLOCK_MONOTONIC` timestamps to real (UTC) time at
+ * export time.
+ *
+ * CTimer stopwatches only read `CLOCK_MONOTONIC`.  To correlate recorded
+ * timestamps with real-time logs, a `ctimer_anchors_t` set holds
+ * (monotonic, realtime) anchor pairs, captured once at initialization and then
+ * periodically off the hot path (e.g., from a reporter thread).  Conversion
+ * interpolates the realtime-minus-monotonic offset linearly between the two
+ * anchors surrounding a timestamp, which absorbs NTP slewing and clock drift
+ * between captures.  Timestamps outside the anchored range use the offset of
+ * the nearest anchor.
+ *
+ * When the anchor set is full, every other anchor is dropped, so the set
+ * always spans the whole run at a gradually coarser resolution.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Capacity of a `ctimer_anchors_t` anchor set (at least 3, so that decimating
+ * a full set frees a slot).  May be overridden before including
+ * `ctimer_anchor.h`.
+ */
+#ifndef CTIMER_ANCHOR_MAX
+#define CTIMER_ANCHOR_MAX 64
+#endif
+#if CTIMER_ANCHOR_MAX < 3
+#error "CTIMER_ANCHOR_MAX must be at least 3"
+#endif
+
+
+/**
+ * (monotonic, realtime) timestamp pair, in nsec.
+ */
+typedef struct {
+    long mono;                  /**< `CLOCK_MONOTONIC` time (nsec) */
+    long real;                  /**< `CLOCK_REALTIME` time (nsec) */
+} ctimer_anchor_t;
+
+
+/**
+ * Set of anchors sorted by monotonic time.
+ */
+typedef struct {
+    ctimer_anchor_t a[CTIMER_ANCHOR_MAX]; /**< Anchors */
+    int             n;                    /**< Number of anchors */
+} ctimer_anchors_t;
+
+
+/**
+ * Capture a (monotonic, realtime) anchor pair.  The realtime clock is read
+ * between two monotonic reads and paired with their midpoint; the tightest of
+ * three attempts is kept.
+ */
+static inline
+ctimer_anchor_t ctimer_anchor_capture(void) {
+    ctimer_anchor_t best = {0, 0};
+    long            best_gap = -1;
+    int             i;
+    for (i = 0; i < 3; ++i) {
+        struct timespec m1, r, m2;
+        long            gap;
+        clock_gettime(CLOCK_MONOTONIC, &m1);
+        clock_gettime(CLOCK_REALTIME,  &r);
+        clock_gettime(CLOCK_MONOTONIC, &m2);
+        gap = timespec_nsec(m2) - timespec_nsec(m1);
+        if ((best_gap < 0) || (gap < best_gap)) {
+            best_gap  = gap;
+            best.mono = timespec_nsec(m1) + gap / 2;
+            best.real = timespec_nsec(r);
+        }
+    }
+    return best;
+}
+
+
+/**
+ * Capture a new anchor and append it to the anchor set.  If the set is full,
+ * every other anchor is dropped first (the first and latest are kept).
+ *
+ * @sa ctimer_anchors_init
+ */
+static inline
+void ctimer_anchors_capture(
+    ctimer_anchors_t * set      /**<[in,out] anchor set */
+) {
+    if (set->n == CTIMER_ANCHOR_MAX) {
+        int i;
+        int j = 0;
+        for (i = 0; i < set->n; i += 2)
+            set->a[j++] = set->a[i];
+        if ((set->n % 2) == 0)
+            set->a[j++] = set->a[set->n - 1];
+        set->n = j;
+    }
+    set->a[set->n++] = ctimer_anchor_capture();
+}
+
+
+/**
+ * Initialize an anchor set with a single freshly captured anchor.
+ */
+static inline
+void ctimer_anchors_init(
+    ctimer_anchors_t * set      /**<[out] anchor set */
+) {
+    set->n = 0;
+    ctimer_anchors_capture(set);
+}
+
+
+/**
+ * Convert a `CLOCK_MONOTONIC` timestamp to `CLOCK_REALTIME`, interpolating
+ * the clock offset between the surrounding anchors.
+ *
+ * @warning The anchor set must hold at least one anchor.
+ *
+ * @return realtime timestamp corresponding to `mono`
+ */
+static inline
+struct timespec ctimer_anchors_realtime(
+    ctimer_anchors_t const * set, /**<[in] anchor set */
+    struct timespec  const   mono /**<[in] monotonic timestamp */
+) {
+    ctimer_anchor_t const * a = set->a;
+    long const              m = timespec_nsec(mono);
+    long                    off;
+    long                    real;
+    struct timespec         ts;
+
+    if ((set->n == 1) || (m <= a[0].mono)) {
+        off = a[0].real - a[0].mono;
+    } else if (m >= a[set->n - 1].mono) {
+        off = a[set->n - 1].real - a[set->n - 1].mono;
+    } else {
+        int lo = 0;
+        int hi = set->n - 1;
+        long off_lo, off_hi;
+        while (hi - lo > 1) {     /* a[lo].mono <= m < a[hi].mono */
+            int const mid = (lo + hi) / 2;
+            if (a[mid].mono <= m)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        off_lo = a[lo].real - a[lo].mono;
+        off_hi = a[hi].real - a[hi].mono;
+        off = off_lo + (long)((double)(off_hi - off_lo)
+                              * (double)(m - a[lo].mono)
+                              / (double)(a[hi].mono - a[lo].mono));
+    }
+
+    real = m + off;
+    ts.tv_sec  = real / _NSEC_PER_SEC;
+    ts.tv_nsec = real % _NSEC_PER_SEC;
+    return ts;
+}
+
+
+/**
+ * Format a `CLOCK_MONOTONIC` timestamp as an ISO 8601 UTC string with nsec
+ * resolution (e.g., `2021-03-04T05:06:07.123456789Z`).
+ *
+ * @return number of characters written (excluding the terminating null
+ * byte), or 0 if `buf` is too small.
+ */
+static inline
+int ctimer_anchors_format_utc(
+    ctimer_anchors_t const * set,  /**<[in]  anchor set */
+    struct timespec  const   mono, /**<[in]  monotonic timestamp */
+    char                   * buf,  /**<[out] output buffer */
+    size_t           const   len   /**<[in]  output buffer size */
+) {
+    struct timespec const real = ctimer_anchors_realtime(set, mono);
+    time_t          const sec  = real.tv_sec;
+    struct tm             tm;
+    size_t                n;
+    int                   m;
+
+    if (gmtime_r(&sec, &tm) == NULL)
+        return 0;
+    n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (n == 0)
+        return 0;
+    m = snprintf(buf + n, len - n, ".%09ldZ", (long)real.tv_nsec);
+    if ((m < 0) || ((size_t)m >= len - n))
+        return 0;
+    return (int)n + m;
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_anchor */
+
+
+#endif  /* __H_CTIMER_ANCHOR__ */
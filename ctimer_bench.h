@@ -0,0 +1,932 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Micro-benchmark harness built on CTimer stopwatches.
+ *
+ * @file        ctimer_bench.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_BENCH__
+#define __H_CTIMER_BENCH__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_bench Benchmark harness API
+ * @ingroup ctimer
+ *
+ * Repeated timing of benchmark functions with fixtures and excluded sections.
+ *
+ * A benchmark is a `ctimer_bench_t` descriptor: a body function, plus optional
+ * `setup` and `teardown` fixture hooks that run before and after each timed
+ * run and are never timed.  The body loops with `ctimer_bench_next()`, and
+ * may exclude per-iteration work (e.g., regenerating inputs) from the measured
+ * time with `ctimer_bench_pause()` / `ctimer_bench_resume()`:
+ *
+ * ```
+ * static void bm_sort(ctimer_bench_state_t * st) {
+ *     int * a = (int *)st->fixture;
+ *     while (ctimer_bench_next(st)) {
+ *         ctimer_bench_pause(st);
+ *         fill_random(a, N);
+ *         ctimer_bench_resume(st);
+ *         sort(a, N);
+ *     }
+ * }
+ * ```
+ *
+ * The runner picks an iteration count so that each run takes at least
+ * `min_time` seconds, then performs `repetitions` runs and reports per-run
+ * and (for more than one repetition) mean/median/stddev results through a
+ * `ctimer_bench_reporter_t`.  Reporters are provided for a console table and
+ * for the JSON format of Google Benchmark, so that existing tooling (e.g.,
+ * `compare.py`) consumes CTimer results unmodified; `ctimer_bench_main()`
+ * accepts the corresponding `--benchmark_*` command-line flags.
+ *
+ * Each pause/resume pair leaves a small, fixed amount of clock overhead inside
+ * the measured wall and CPU times.  The runner calibrates that overhead once
+ * and subtracts it from every run, and warns (on `stderr`) when the subtracted overhead
+ * exceeds `overhead_warn` of the measured time, in which case the excluded
+ * sections are too fine-grained for reliable measurement.
+ *
+ * Wall time is measured with `CLOCK_MONOTONIC` and CPU time with
+ * `CLOCK_THREAD_CPUTIME_ID`.
+ *
+ * @note Programs using the harness must link with `-lm`.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Benchmark run state, passed to benchmark bodies and fixture hooks.
+ */
+typedef struct {
+    unsigned long   iterations; /**< Iterations in this run */
+    void          * fixture;    /**< Fixture data (set by `setup`) */
+    void          * arg;        /**< Benchmark argument */
+    ctimer_t        real;       /**< Wall-time stopwatch */
+    struct timespec cpu;        /**< Accumulated CPU time */
+    struct timespec cpu_mark;   /**< CPU time at last resume */
+    unsigned long   pauses;     /**< Number of pause/resume pairs */
+    unsigned long   _i;         /* iterations started */
+} ctimer_bench_state_t;
+
+
+/**
+ * Benchmark descriptor.
+ */
+typedef struct {
+    char const * name;                            /**< Benchmark name */
+    void (*fn)(ctimer_bench_state_t * st);        /**< Benchmark body */
+    void (*setup)(ctimer_bench_state_t * st);     /**< Fixture setup or NULL */
+    void (*teardown)(ctimer_bench_state_t * st);  /**< Fixture teardown or NULL */
+    void       * arg;                             /**< Argument for all hooks */
+} ctimer_bench_t;
+
+
+/**
+ * Result of one benchmark run, or an aggregate over repetitions.  Times are
+ * per iteration, in nsec.
+ */
+typedef struct {
+    char const    * name;       /**< Benchmark name */
+    char const    * aggregate;  /**< "mean", "median", "stddev", or NULL */
+    int             repetition; /**< Repetition index */
+    int             repetitions;/**< Number of repetitions */
+    unsigned long   iterations; /**< Iterations per run */
+    double          real_time;  /**< Wall time per iteration (nsec) */
+    double          cpu_time;   /**< CPU time per iteration (nsec) */
+    double          overhead;   /**< Compensated overhead / measured time */
+} ctimer_bench_result_t;
+
+
+/**
+ * Benchmark result reporter: callbacks invoked as results become available.
+ * Any callback may be NULL.
+ */
+typedef struct ctimer_bench_reporter {
+    void (*begin)(struct ctimer_bench_reporter * r); /**< Before all runs */
+    void (*result)(struct ctimer_bench_reporter * r,
+                   ctimer_bench_result_t const * res); /**< After each result */
+    void (*end)(struct ctimer_bench_reporter * r);   /**< After all runs */
+    FILE       * out;           /**< Output stream */
+    int          count;         /**< Results reported so far */
+    int          family;        /**< Index of the current benchmark family */
+    char const * last;          /**< Name of the last reported benchmark */
+    void       * ctx;           /**< Reporter-specific state */
+} ctimer_bench_reporter_t;
+
+
+/**
+ * Benchmark runner options.
+ *
+ * @sa ctimer_bench_options_init
+ */
+typedef struct {
+    double min_time;            /**< Minimum time per run (sec) */
+    int    repetitions;         /**< Runs per benchmark */
+    double overhead_warn;       /**< Overhead fraction that triggers warnings */
+    double pause_real;          /**< Pause/resume wall-time overhead (nsec) */
+    double pause_cpu;           /**< Pause/resume CPU-time overhead (nsec) */
+} ctimer_bench_options_t;
+
+
+/* ==================================================
+ * BENCHMARK BODY API
+ * ================================================== */
+
+
+/**
+ * Stop timing the current iteration (wall and CPU time) until
+ * `ctimer_bench_resume()`.
+ */
+static inline
+void ctimer_bench_pause(
+    ctimer_bench_state_t * st   /**<[in,out] run state */
+) {
+    struct timespec now;
+    ctimer_pause(&st->real);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    _timespec_accum(&st->cpu, now, st->cpu_mark);
+    st->pauses++;
+}
+
+
+/**
+ * Resume timing after `ctimer_bench_pause()`.
+ */
+static inline
+void ctimer_bench_resume(
+    ctimer_bench_state_t * st   /**<[in,out] run state */
+) {
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &st->cpu_mark);
+    ctimer_resume(&st->real);
+}
+
+
+/**
+ * Advance the benchmark loop.  Starts timing on the first call and stops it
+ * when all iterations are done.
+ *
+ * @return 1 while iterations remain, 0 afterwards
+ */
+static inline
+int ctimer_bench_next(
+    ctimer_bench_state_t * st   /**<[in,out] run state */
+) {
+    if (__builtin_expect(st->_i < st->iterations, 1)) {
+        if (__builtin_expect(st->_i++ == 0, 0))
+            ctimer_bench_resume(st);
+        return 1;
+    }
+    if (st->real.running) {
+        ctimer_bench_pause(st);
+        st->pauses--;           /* final stop is not an excluded section */
+    }
+    return 0;
+}
+
+
+/* ==================================================
+ * RUNNER API
+ * ================================================== */
+
+
+/* run the benchmark once with `iters` iterations, fixtures untimed */
+static inline
+void _ctimer_bench_once(
+    ctimer_bench_t       const * b,
+    unsigned long        const   iters,
+    ctimer_bench_state_t       * st
+) {
+    memset(st, 0, sizeof(*st));
+    ctimer_reset(&st->real);
+    st->iterations = iters;
+    st->arg        = b->arg;
+    if (b->setup != NULL)
+        b->setup(st);
+    b->fn(st);
+    if (st->real.running)       /* body returned early */
+        ctimer_bench_pause(st);
+    if (b->teardown != NULL)
+        b->teardown(st);
+}
+
+
+/* empty body used to calibrate the overhead of pause/resume pairs */
+static inline
+void _ctimer_bench_pause_body(
+    ctimer_bench_state_t * st
+) {
+    while (ctimer_bench_next(st)) {
+        ctimer_bench_pause(st);
+        ctimer_bench_resume(st);
+    }
+}
+
+
+static inline
+void _ctimer_bench_empty_body(
+    ctimer_bench_state_t * st
+) {
+    while (ctimer_bench_next(st))
+        __asm__ __volatile__("" ::: "memory");
+}
+
+
+/**
+ * Measure the wall and CPU time (nsec) that one `ctimer_bench_pause()` /
+ * `ctimer_bench_resume()` pair adds to the measured times, as the minimum
+ * over 5 trials.
+ */
+static inline
+void ctimer_bench_calibrate_pause(
+    double * real,              /**<[out] wall-time overhead per pair */
+    double * cpu                /**<[out] CPU-time overhead per pair */
+) {
+    ctimer_bench_t const pb = {"", _ctimer_bench_pause_body, NULL, NULL, NULL};
+    ctimer_bench_t const eb = {"", _ctimer_bench_empty_body, NULL, NULL, NULL};
+    unsigned long const  n  = 100000;
+    int                  rep;
+
+    *real = *cpu = -1;
+    for (rep = 0; rep < 5; ++rep) {
+        ctimer_bench_state_t st;
+        double               r, c;
+        _ctimer_bench_once(&pb, n, &st);
+        r = (double)timespec_nsec(st.real.elapsed);
+        c = (double)timespec_nsec(st.cpu);
+        _ctimer_bench_once(&eb, n, &st);
+        r = (r - (double)timespec_nsec(st.real.elapsed)) / (double)n;
+        c = (c - (double)timespec_nsec(st.cpu)) / (double)n;
+        if ((*real < 0) || (r < *real))
+            *real = r;
+        if ((*cpu < 0) || (c < *cpu))
+            *cpu = c;
+    }
+    if (*real < 0)
+        *real = 0;
+    if (*cpu < 0)
+        *cpu = 0;
+}
+
+
+/**
+ * Initialize runner options with defaults (0.5 sec minimum run time, 1
+ * repetition, warn at 10% overhead) and calibrate the pause/resume overhead.
+ */
+static inline
+void ctimer_bench_options_init(
+    ctimer_bench_options_t * o  /**<[out] runner options */
+) {
+    o->min_time      = 0.5;
+    o->repetitions   = 1;
+    o->overhead_warn = 0.1;
+    ctimer_bench_calibrate_pause(&o->pause_real, &o->pause_cpu);
+}
+
+
+/* fill a per-run result from a finished run state */
+static inline
+void _ctimer_bench_result(
+    ctimer_bench_result_t        * res,
+    ctimer_bench_state_t   const * st,
+    ctimer_bench_options_t const * o
+) {
+    double const real  = (double)timespec_nsec(st->real.elapsed);
+    double const cpu   = (double)timespec_nsec(st->cpu);
+    double const rcomp = (double)st->pauses * o->pause_real;
+    double const ccomp = (double)st->pauses * o->pause_cpu;
+    double const n     = (double)(st->iterations > 0 ? st->iterations : 1);
+    res->iterations = st->iterations;
+    res->overhead   = (real > 0) ? rcomp / real : 0;
+    res->real_time  = ((real > rcomp) ? real - rcomp : 0) / n;
+    res->cpu_time   = ((cpu > ccomp) ? cpu - ccomp : 0) / n;
+}
+
+
+static inline
+int _ctimer_bench_cmp_double(
+    void const * a,
+    void const * b
+) {
+    double const x = *(double const *)a;
+    double const y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+
+/* median of n values (sorts the array) */
+static inline
+double _ctimer_bench_median(
+    double * v,
+    int      n
+) {
+    qsort(v, (size_t)n, sizeof(double), _ctimer_bench_cmp_double);
+    return (n % 2) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+
+/* report mean/median/stddev aggregates over n repetitions */
+static inline
+void _ctimer_bench_aggregates(
+    ctimer_bench_result_t   const * runs,
+    int                     const   n,
+    ctimer_bench_reporter_t       * r
+) {
+    ctimer_bench_result_t agg = runs[0];
+    double              * rv  = (double *)malloc(2 * (size_t)n * sizeof(double));
+    double              * cv;
+    double                rm = 0, cm = 0, rs = 0, cs = 0;
+    int                   i;
+
+    if (rv == NULL)
+        return;
+    cv = rv + n;
+    for (i = 0; i < n; ++i) {
+        rv[i] = runs[i].real_time;
+        cv[i] = runs[i].cpu_time;
+        rm += rv[i] / n;
+        cm += cv[i] / n;
+    }
+    for (i = 0; i < n; ++i) {
+        rs += (rv[i] - rm) * (rv[i] - rm);
+        cs += (cv[i] - cm) * (cv[i] - cm);
+    }
+    agg.repetition = 0;
+    agg.overhead   = 0;
+    agg.iterations = (unsigned long)n; /* as in Google Benchmark */
+
+    agg.aggregate = "mean";
+    agg.real_time = rm;
+    agg.cpu_time  = cm;
+    if (r->result != NULL)
+        r->result(r, &agg);
+
+    agg.aggregate = "median";
+    agg.real_time = _ctimer_bench_median(rv, n);
+    agg.cpu_time  = _ctimer_bench_median(cv, n);
+    if (r->result != NULL)
+        r->result(r, &agg);
+
+    agg.aggregate = "stddev";
+    agg.real_time = (n > 1) ? sqrt(rs / (n - 1)) : 0;
+    agg.cpu_time  = (n > 1) ? sqrt(cs / (n - 1)) : 0;
+    if (r->result != NULL)
+        r->result(r, &agg);
+
+    free(rv);
+}
+
+
+/**
+ * Run one benchmark: pick the iteration count, then perform and report
+ * `repetitions` runs and their aggregates.
+ *
+ * @return 0 on success, or -1 on allocation failure
+ */
+static inline
+int ctimer_bench_run(
+    ctimer_bench_t          const * b, /**<[in]     benchmark */
+    ctimer_bench_options_t  const * o, /**<[in]     runner options */
+    ctimer_bench_reporter_t       * r  /**<[in,out] result reporter */
+) {
+    int const               reps  = (o->repetitions > 0) ? o->repetitions : 1;
+    double const            min_t = o->min_time * 1e9;
+    unsigned long           iters = 1;
+    ctimer_bench_state_t    st;
+    ctimer_bench_result_t * runs;
+    int                     i;
+
+    /* grow the iteration count until one run takes at least min_time */
+    for (;;) {
+        double elapsed, next;
+        _ctimer_bench_once(b, iters, &st);
+        elapsed = (double)timespec_nsec(st.real.elapsed);
+        if ((elapsed >= min_t) || (iters >= 1000000000UL))
+            break;
+        next = (elapsed > 0) ? 1.4 * min_t / elapsed * (double)iters
+                             : 10.0 * (double)iters;
+        if (next > 10.0 * (double)iters)
+            next = 10.0 * (double)iters;
+        if (next > 1e9)
+            next = 1e9;
+        iters = ((unsigned long)next > iters) ? (unsigned long)next : iters + 1;
+    }
+
+    runs = (ctimer_bench_result_t *)malloc((size_t)reps * sizeof(*runs));
+    if (runs == NULL)
+        return -1;
+    for (i = 0; i < reps; ++i) {
+        if (i > 0)
+            _ctimer_bench_once(b, iters, &st);
+        runs[i].name        = b->name;
+        runs[i].aggregate   = NULL;
+        runs[i].repetition  = i;
+        runs[i].repetitions = reps;
+        _ctimer_bench_result(&runs[i], &st, o);
+        if (runs[i].overhead > o->overhead_warn)
+            fprintf(stderr, "warning: %s: pause/resume overhead is %.0f%% of"
+                    " measured time; excluded sections are too fine-grained\n",
+                    b->name, 100 * runs[i].overhead);
+        if (r->result != NULL)
+            r->result(r, &runs[i]);
+    }
+    if (reps > 1)
+        _ctimer_bench_aggregates(runs, reps, r);
+    free(runs);
+    return 0;
+}
+
+
+/**
+ * Run `n` benchmarks in order, bracketed by the reporter's `begin` and `end`
+ * callbacks.
+ *
+ * @return 0 on success, or -1 if any benchmark failed to run
+ */
+static inline
+int ctimer_bench_run_all(
+    ctimer_bench_t          const * bs, /**<[in]     benchmarks */
+    int                     const   n,  /**<[in]     number of benchmarks */
+    ctimer_bench_options_t  const * o,  /**<[in]     runner options */
+    ctimer_bench_reporter_t       * r   /**<[in,out] result reporter */
+) {
+    int ret = 0;
+    int i;
+    if (r->begin != NULL)
+        r->begin(r);
+    for (i = 0; i < n; ++i)
+        if (ctimer_bench_run(&bs[i], o, r) != 0)
+            ret = -1;
+    if (r->end != NULL)
+        r->end(r);
+    return ret;
+}
+
+
+/* ==================================================
+ * CONSOLE REPORTER
+ * ================================================== */
+
+
+static inline
+void _ctimer_bench_console_begin(
+    ctimer_bench_reporter_t * r
+) {
+    fprintf(r->out, "%-40s %15s %15s %12s\n",
+            "Benchmark", "Time", "CPU", "Iterations");
+}
+
+
+static inline
+void _ctimer_bench_console_result(
+    ctimer_bench_reporter_t     * r,
+    ctimer_bench_result_t const * res
+) {
+    char name[256];
+    if (res->aggregate != NULL)
+        snprintf(name, sizeof(name), "%s_%s", res->name, res->aggregate);
+    else
+        snprintf(name, sizeof(name), "%s", res->name);
+    fprintf(r->out, "%-40s %12.1f ns %12.1f ns %12lu\n",
+            name, res->real_time, res->cpu_time, res->iterations);
+    r->count++;
+}
+
+
+/**
+ * Return a reporter that prints one table row per result to `out`.
+ */
+static inline
+ctimer_bench_reporter_t ctimer_bench_console_reporter(
+    FILE * out                  /**<[in] output stream */
+) {
+    ctimer_bench_reporter_t r;
+    memset(&r, 0, sizeof(r));
+    r.begin  = _ctimer_bench_console_begin;
+    r.result = _ctimer_bench_console_result;
+    r.out    = out;
+    return r;
+}
+
+
+/* ==================================================
+ * JSON REPORTER
+ * ================================================== */
+
+
+/* write a JSON string literal */
+static inline
+void _ctimer_bench_json_str(
+    FILE       * out,
+    char const * s
+) {
+    fputc('"', out);
+    for (; (s != NULL) && (*s != '\0'); ++s) {
+        unsigned char const c = (unsigned char)*s;
+        if ((c == '"') || (c == '\\'))
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+
+/* read the first line of a small text file; 0 on success */
+static inline
+int _ctimer_bench_read_line(
+    char const * path,
+    char       * buf,
+    int const    len
+) {
+    FILE * f = fopen(path, "r");
+    char * nl;
+    if (f == NULL)
+        return -1;
+    if (fgets(buf, len, f) == NULL) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    if ((nl = strchr(buf, '\n')) != NULL)
+        *nl = '\0';
+    return 0;
+}
+
+
+/* write the "caches" array of the context block from sysfs */
+static inline
+void _ctimer_bench_json_caches(
+    FILE * out
+) {
+    int i;
+    int first = 1;
+    fprintf(out, "    \"caches\": [");
+    for (i = 0; i < 16; ++i) {
+        char          path[96];
+        char          type[32], level[16], size[32], map[256];
+        long          bytes;
+        int           sharing = 0;
+        char        * p;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        if (_ctimer_bench_read_line(path, type, sizeof(type)) != 0)
+            break;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if (_ctimer_bench_read_line(path, level, sizeof(level)) != 0)
+            break;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        if (_ctimer_bench_read_line(path, size, sizeof(size)) != 0)
+            break;
+        bytes = strtol(size, &p, 10);
+        if ((*p == 'K') || (*p == 'k'))
+            bytes *= 1024;
+        else if (*p == 'M')
+            bytes *= 1024 * 1024;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/shared_cpu_map",
+                 i);
+        if (_ctimer_bench_read_line(path, map, sizeof(map)) == 0)
+            for (p = map; *p != '\0'; ++p)
+                if (((*p >= '0') && (*p <= '9')) || ((*p >= 'a') && (*p <= 'f')))
+                    sharing += __builtin_popcount(
+                        (unsigned)((*p <= '9') ? *p - '0' : *p - 'a' + 10));
+        fprintf(out, "%s\n      {\n        \"type\": ", first ? "" : ",");
+        _ctimer_bench_json_str(out, type);
+        fprintf(out, ",\n        \"level\": %d,\n        \"size\": %ld,\n"
+                "        \"num_sharing\": %d\n      }",
+                atoi(level), bytes, sharing);
+        first = 0;
+    }
+    fprintf(out, "%s],\n", first ? "" : "\n    ");
+}
+
+
+static inline
+void _ctimer_bench_json_begin(
+    ctimer_bench_reporter_t * r
+) {
+    FILE      * out = r->out;
+    char        buf[256];
+    char        date[64];
+    time_t      now = time(NULL);
+    struct tm   tm;
+    double      mhz = 0;
+    double      load[3] = {0, 0, 0};
+    int         scaling = 0;
+    ssize_t     n;
+
+    /* ISO 8601 with a +hh:mm offset, as in Google Benchmark */
+    localtime_r(&now, &tm);
+    strftime(date, sizeof(date) - 1, "%Y-%m-%dT%H:%M:%S%z", &tm);
+    n = (ssize_t)strlen(date);
+    if (n >= 5) {
+        memmove(date + n - 1, date + n - 2, 3);
+        date[n - 2] = ':';
+    }
+
+    if (_ctimer_bench_read_line(
+            "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq",
+            buf, sizeof(buf)) == 0)
+        mhz = atof(buf) / 1000;
+    else {
+        FILE * f = fopen("/proc/cpuinfo", "r");
+        while ((f != NULL) && (fgets(buf, sizeof(buf), f) != NULL))
+            if (strncmp(buf, "cpu MHz", 7) == 0) {
+                mhz = atof(strchr(buf, ':') + 1);
+                break;
+            }
+        if (f != NULL)
+            fclose(f);
+    }
+    if (_ctimer_bench_read_line(
+            "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor",
+            buf, sizeof(buf)) == 0)
+        scaling = (strcmp(buf, "performance") != 0);
+    if (_ctimer_bench_read_line("/proc/loadavg", buf, sizeof(buf)) == 0)
+        sscanf(buf, "%lf %lf %lf", &load[0], &load[1], &load[2]);
+
+    fprintf(out, "{\n  \"context\": {\n    \"date\": ");
+    _ctimer_bench_json_str(out, date);
+    if (gethostname(buf, sizeof(buf)) != 0)
+        buf[0] = '\0';
+    buf[sizeof(buf) - 1] = '\0';
+    fprintf(out, ",\n    \"host_name\": ");
+    _ctimer_bench_json_str(out, buf);
+    n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    buf[(n > 0) ? n : 0] = '\0';
+    fprintf(out, ",\n    \"executable\": ");
+    _ctimer_bench_json_str(out, buf);
+    fprintf(out, ",\n    \"num_cpus\": %ld,\n    \"mhz_per_cpu\": %.0f,\n"
+            "    \"cpu_scaling_enabled\": %s,\n",
+            sysconf(_SC_NPROCESSORS_ONLN), mhz, scaling ? "true" : "false");
+    _ctimer_bench_json_caches(out);
+    fprintf(out, "    \"load_avg\": [%g,%g,%g],\n", load[0], load[1], load[2]);
+#ifdef NDEBUG
+    fprintf(out, "    \"library_build_type\": \"release\"\n  },\n");
+#else
+    fprintf(out, "    \"library_build_type\": \"debug\"\n  },\n");
+#endif
+    fprintf(out, "  \"benchmarks\": [");
+    fflush(out);
+}
+
+
+static inline
+void _ctimer_bench_json_result(
+    ctimer_bench_reporter_t     * r,
+    ctimer_bench_result_t const * res
+) {
+    FILE * out = r->out;
+    char   name[256];
+
+    if ((r->last == NULL) || (strcmp(r->last, res->name) != 0)) {
+        r->family += (r->last != NULL);
+        r->last = res->name;
+    }
+    if (res->aggregate != NULL)
+        snprintf(name, sizeof(name), "%s_%s", res->name, res->aggregate);
+    else
+        snprintf(name, sizeof(name), "%s", res->name);
+
+    fprintf(out, "%s\n    {\n      \"name\": ", (r->count > 0) ? "," : "");
+    _ctimer_bench_json_str(out, name);
+    fprintf(out, ",\n      \"family_index\": %d,\n"
+            "      \"per_family_instance_index\": 0,\n      \"run_name\": ",
+            r->family);
+    _ctimer_bench_json_str(out, res->name);
+    fprintf(out, ",\n      \"run_type\": \"%s\",\n      \"repetitions\": %d,\n",
+            (res->aggregate != NULL) ? "aggregate" : "iteration",
+            res->repetitions);
+    if (res->aggregate != NULL)
+        fprintf(out, "      \"threads\": 1,\n      \"aggregate_name\": \"%s\",\n"
+                "      \"aggregate_unit\": \"time\",\n", res->aggregate);
+    else
+        fprintf(out, "      \"repetition_index\": %d,\n      \"threads\": 1,\n",
+                res->repetition);
+    fprintf(out, "      \"iterations\": %lu,\n      \"real_time\": %.17g,\n"
+            "      \"cpu_time\": %.17g,\n      \"time_unit\": \"ns\"\n    }",
+            res->iterations, res->real_time, res->cpu_time);
+    fflush(out);
+    r->count++;
+}
+
+
+static inline
+void _ctimer_bench_json_end(
+    ctimer_bench_reporter_t * r
+) {
+    fprintf(r->out, "%s]\n}\n", (r->count > 0) ? "\n  " : "");
+    fflush(r->out);
+}
+
+
+/**
+ * Return a reporter that streams results to `out` in the JSON format of
+ * Google Benchmark (`--benchmark_format=json`): a `context` block describing
+ * the host, followed by a `benchmarks` array with one object per run or
+ * aggregate.  Each object is written (and flushed) as soon as the result is
+ * available, so nothing is buffered in memory.
+ */
+static inline
+ctimer_bench_reporter_t ctimer_bench_json_reporter(
+    FILE * out                  /**<[in] output stream */
+) {
+    ctimer_bench_reporter_t r;
+    memset(&r, 0, sizeof(r));
+    r.begin  = _ctimer_bench_json_begin;
+    r.result = _ctimer_bench_json_result;
+    r.end    = _ctimer_bench_json_end;
+    r.out    = out;
+    return r;
+}
+
+
+/* ==================================================
+ * COMMAND-LINE DRIVER
+ * ================================================== */
+
+
+/* forward reporter callbacks to a pair of reporters in r->ctx */
+static inline
+void _ctimer_bench_tee_begin(
+    ctimer_bench_reporter_t * r
+) {
+    ctimer_bench_reporter_t * rs = (ctimer_bench_reporter_t *)r->ctx;
+    int                       i;
+    for (i = 0; i < 2; ++i)
+        if (rs[i].begin != NULL)
+            rs[i].begin(&rs[i]);
+}
+
+
+static inline
+void _ctimer_bench_tee_result(
+    ctimer_bench_reporter_t     * r,
+    ctimer_bench_result_t const * res
+) {
+    ctimer_bench_reporter_t * rs = (ctimer_bench_reporter_t *)r->ctx;
+    int                       i;
+    for (i = 0; i < 2; ++i)
+        if (rs[i].result != NULL)
+            rs[i].result(&rs[i], res);
+}
+
+
+static inline
+void _ctimer_bench_tee_end(
+    ctimer_bench_reporter_t * r
+) {
+    ctimer_bench_reporter_t * rs = (ctimer_bench_reporter_t *)r->ctx;
+    int                       i;
+    for (i = 0; i < 2; ++i)
+        if (rs[i].end != NULL)
+            rs[i].end(&rs[i]);
+}
+
+
+/**
+ * Run benchmarks with options parsed from Google Benchmark-style command-line
+ * flags, so that existing scripts can drive CTimer benchmarks unmodified:
+ *
+ * - `--benchmark_format=<console|json>` (stdout format; default console)
+ * - `--benchmark_out=<file>` (also write JSON results to `file`)
+ * - `--benchmark_repetitions=<n>`
+ * - `--benchmark_min_time=<sec>` (a trailing `s` is accepted)
+ * - `--benchmark_filter=<substring>` (run benchmarks whose name contains it)
+ *
+ * @return 0 on success, 1 on bad flags or run failures (suitable as an exit
+ * status)
+ */
+static inline
+int ctimer_bench_main(
+    ctimer_bench_t const * bs,   /**<[in] benchmarks */
+    int            const   n,    /**<[in] number of benchmarks */
+    int            const   argc, /**<[in] argument count */
+    char         * const * argv  /**<[in] arguments */
+) {
+    ctimer_bench_options_t  o;
+    ctimer_bench_reporter_t rs[2];
+    ctimer_bench_reporter_t tee;
+    char const            * format = "console";
+    char const            * outfile = NULL;
+    char const            * filter = NULL;
+    FILE                  * out = NULL;
+    int                     ret = 0;
+    int                     i;
+
+    ctimer_bench_options_init(&o);
+    for (i = 1; i < argc; ++i) {
+        char const * a = argv[i];
+        if (strncmp(a, "--benchmark_format=", 19) == 0)
+            format = a + 19;
+        else if (strncmp(a, "--benchmark_out=", 16) == 0)
+            outfile = a + 16;
+        else if (strncmp(a, "--benchmark_repetitions=", 24) == 0)
+            o.repetitions = atoi(a + 24);
+        else if (strncmp(a, "--benchmark_min_time=", 21) == 0)
+            o.min_time = atof(a + 21);
+        else if (strncmp(a, "--benchmark_filter=", 19) == 0)
+            filter = a + 19;
+        else if (strncmp(a, "--benchmark_out_format=", 23) != 0) {
+            fprintf(stderr, "%s: unrecognized flag '%s'\n", argv[0], a);
+            return 1;
+        }
+    }
+
+    if (strcmp(format, "json") == 0)
+        rs[0] = ctimer_bench_json_reporter(stdout);
+    else if (strcmp(format, "console") == 0)
+        rs[0] = ctimer_bench_console_reporter(stdout);
+    else {
+        fprintf(stderr, "%s: unsupported format '%s'\n", argv[0], format);
+        return 1;
+    }
+    memset(&rs[1], 0, sizeof(rs[1]));
+    if (outfile != NULL) {
+        out = fopen(outfile, "w");
+        if (out == NULL) {
+            perror(outfile);
+            return 1;
+        }
+        rs[1] = ctimer_bench_json_reporter(out);
+    }
+    memset(&tee, 0, sizeof(tee));
+    tee.begin  = _ctimer_bench_tee_begin;
+    tee.result = _ctimer_bench_tee_result;
+    tee.end    = _ctimer_bench_tee_end;
+    tee.ctx    = rs;
+
+    tee.begin(&tee);
+    for (i = 0; i < n; ++i)
+        if (((filter == NULL) || (strstr(bs[i].name, filter) != NULL))
+            && (ctimer_bench_run(&bs[i], &o, &tee) != 0))
+            ret = 1;
+    tee.end(&tee);
+    if (out != NULL)
+        fclose(out);
+    return ret;
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_bench */
+
+
+#endif  /* __H_CTIMER_BENCH__ */
@@ -0,0 +1,247 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Huge-page-backed, prefaulted buffers for CTimer traces and histograms.
+ *
+ * @file        ctimer_buf.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_BUF__
+#define __H_CTIMER_BUF__
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_buf Buffer allocation API
+ * @ingroup ctimer
+ *
+ * Anonymous memory buffers backed by huge pages where possible.
+ *
+ * Large trace and histogram buffers touched at high rates suffer TLB misses
+ * with 4 KiB pages.  `ctimer_buf_alloc()` tries, in order:
+ *
+ * 1. explicit huge pages (`MAP_HUGETLB`), which require a reserved pool
+ *    (`/proc/sys/vm/nr_hugepages`);
+ * 2. transparent huge pages (`madvise(MADV_HUGEPAGE)` on a 2 MiB-aligned
+ *    mapping), which the kernel may or may not honor; and
+ * 3. regular pages.
+ *
+ * Buffers smaller than `CTIMER_HUGEPAGE_SIZE` always use regular pages, since
+ * a huge page would mostly be wasted on them.
+ *
+ * The requested bytes are then prefaulted, by writing to every page from the
+ * calling thread, so that the first writes on the hot path do not page-fault
+ * (and so that pages are placed on the caller's NUMA node).  The `backing`
+ * field reports which backing was obtained.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Huge page size assumed for rounding and alignment; smaller buffers use
+ * regular pages. */
+#ifndef CTIMER_HUGEPAGE_SIZE
+#define CTIMER_HUGEPAGE_SIZE (2UL * 1024 * 1024)
+#endif
+
+
+/**
+ * Buffer backings.
+ */
+enum {
+    CTIMER_BUF_NONE    = 0,     /**< Not allocated */
+    CTIMER_BUF_HUGETLB = 1,     /**< Explicit huge pages (`MAP_HUGETLB`) */
+    CTIMER_BUF_THP     = 2,     /**< Transparent huge pages (advised) */
+    CTIMER_BUF_SMALL   = 3      /**< Regular pages */
+};
+
+
+/**
+ * Buffer allocation flags.
+ */
+enum {
+    CTIMER_BUF_NO_HUGE     = 1 << 0, /**< Only use regular pages */
+    CTIMER_BUF_NO_HUGETLB  = 1 << 1, /**< Skip `MAP_HUGETLB` */
+    CTIMER_BUF_NO_PREFAULT = 1 << 2  /**< Do not prefault the buffer */
+};
+
+
+/**
+ * Anonymous memory buffer.
+ */
+typedef struct {
+    void   * ptr;               /**< Buffer start */
+    size_t   bytes;             /**< Usable buffer size */
+    void   * map;               /**< Mapping start */
+    size_t   map_bytes;         /**< Mapping size */
+    int      backing;           /**< `CTIMER_BUF_*` backing */
+} ctimer_buf_t;
+
+
+/**
+ * Return a short name for a `CTIMER_BUF_*` backing: "hugetlb", "thp",
+ * "small", or "none".
+ */
+static inline
+char const * ctimer_buf_backing_name(
+    int const backing           /**<[in] `CTIMER_BUF_*` backing */
+) {
+    switch (backing) {
+    case CTIMER_BUF_HUGETLB: return "hugetlb";
+    case CTIMER_BUF_THP:     return "thp";
+    case CTIMER_BUF_SMALL:   return "small";
+    default:                 return "none";
+    }
+}
+
+
+/**
+ * Allocate a zero-filled buffer of at least `bytes` bytes, preferring huge
+ * pages if `bytes` is at least `CTIMER_HUGEPAGE_SIZE`, and prefault the
+ * requested bytes unless `CTIMER_BUF_NO_PREFAULT` is set.
+ *
+ * @return 0 on success, or -1 on failure (`b->backing` is
+ * `CTIMER_BUF_NONE`)
+ *
+ * @sa ctimer_buf_free
+ */
+static inline
+int ctimer_buf_alloc(
+    ctimer_buf_t * b,           /**<[out] buffer */
+    size_t const   bytes,       /**<[in]  requested size */
+    int const      flags        /**<[in]  `CTIMER_BUF_*` flags */
+) {
+    size_t const huge  = CTIMER_HUGEPAGE_SIZE;
+    size_t const page  = (size_t)sysconf(_SC_PAGESIZE);
+    size_t const hsize = (bytes + huge - 1) / huge * huge;
+    int    const nohuge = (flags & CTIMER_BUF_NO_HUGE) || (bytes < huge);
+    void       * p;
+
+    b->ptr = b->map = NULL;
+    b->bytes = b->map_bytes = 0;
+    b->backing = CTIMER_BUF_NONE;
+    if (bytes == 0)
+        return -1;
+
+#ifdef MAP_HUGETLB
+    if (!nohuge && !(flags & CTIMER_BUF_NO_HUGETLB)) {
+        p = mmap(NULL, hsize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            b->ptr = b->map = p;
+            b->bytes = b->map_bytes = hsize;
+            b->backing = CTIMER_BUF_HUGETLB;
+        }
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    if ((b->backing == CTIMER_BUF_NONE) && !nohuge) {
+        /* over-allocate to carve out a huge-page-aligned region */
+        p = mmap(NULL, hsize + huge, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            uintptr_t const a = ((uintptr_t)p + huge - 1) & ~(uintptr_t)(huge - 1);
+            b->map = p;
+            b->map_bytes = hsize + huge;
+            b->ptr = (void *)a;
+            b->bytes = hsize;
+            if (madvise(b->ptr, b->bytes, MADV_HUGEPAGE) == 0) {
+                b->backing = CTIMER_BUF_THP;
+            } else {
+                munmap(b->map, b->map_bytes);
+                b->ptr = b->map = NULL;
+                b->bytes = b->map_bytes = 0;
+            }
+        }
+    }
+#endif
+
+    if (b->backing == CTIMER_BUF_NONE) {
+        size_t const psize = (bytes + page - 1) / page * page;
+        p = mmap(NULL, psize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return -1;
+        b->ptr = b->map = p;
+        b->bytes = b->map_bytes = psize;
+        b->backing = CTIMER_BUF_SMALL;
+    }
+
+    if (!(flags & CTIMER_BUF_NO_PREFAULT)) {
+        volatile char * c = (volatile char *)b->ptr;
+        size_t          i;
+        for (i = 0; i < bytes; i += page)
+            c[i] = 0;
+    }
+    return 0;
+}
+
+
+/**
+ * Release a buffer allocated with `ctimer_buf_alloc()`.
+ */
+static inline
+void ctimer_buf_free(
+    ctimer_buf_t * b            /**<[in,out] buffer */
+) {
+    if (b->map != NULL)
+        munmap(b->map, b->map_bytes);
+    b->ptr = b->map = NULL;
+    b->bytes = b->map_bytes = 0;
+    b->backing = CTIMER_BUF_NONE;
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_buf */
+
+
+#endif  /* __H_CTIMER_BUF__ */
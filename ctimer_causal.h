@@ -0,0 +1,550 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * CTimer causal profiling: virtual speedups of instrumented regions.
+ *
+ * @file        ctimer_causal.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_CAUSAL__
+#define __H_CTIMER_CAUSAL__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_causal Causal profiling API
+ * @ingroup ctimer
+ *
+ * Estimates of what speeding up a region of code would buy, in the manner of
+ * Coz (Curtsinger & Berger, SOSP 2015).
+ *
+ * Regions are delimited with `ctimer_causal_region_start()` and
+ * `ctimer_causal_region_stop()` around a `ctimer_t` stopwatch, and progress
+ * points count laps of the program's unit of work with
+ * `ctimer_causal_progress()` (throughput) or `ctimer_causal_latency()`
+ * (throughput and latency of work started at `ctimer_causal_now()`).
+ *
+ * An experiment selects one region and a speedup `s` (a multiple of
+ * `CTIMER_CAUSAL_STEP` percent).  Speeding up a region directly is not
+ * possible, but the relative effect can be emulated: whenever a thread
+ * completes the selected region after `d` nsec, every *other* thread is
+ * paused for `s * d` nsec.  Each thread keeps a count of the delays it has
+ * paused for (or, when it ran the selected region, was credited with) and
+ * pays any shortfall against the global count at its next region boundary
+ * or progress point.  The experiment's effective duration is its wall-clock
+ * duration minus the inserted delay, so its progress rate is that of a
+ * program where the region ran `s` times faster.  Latencies are measured on
+ * a per-thread virtual clock that excludes the thread's delays.
+ *
+ * `ctimer_causal_begin()` starts a driver thread that runs experiments of
+ * fixed duration back to back: each picks a random region and either no
+ * speedup (a baseline, half of the time) or a random non-zero one.
+ * `ctimer_causal_end()` stops it, and `ctimer_causal_print()` ranks the
+ * regions of a progress point by the estimated throughput gain per unit of
+ * speedup (a least-squares slope), with the relative throughput and latency
+ * change at each speedup.
+ *
+ * @note Regions and progress points must be registered before
+ * `ctimer_causal_begin()`.  A thread that blocks (e.g., waits for I/O or on
+ * a lock) does not pay delays while blocked, and pays all of them when it
+ * next reaches a region or progress point; call `ctimer_causal_skip()` after
+ * waits that are not caused by other instrumented threads (as Coz does for
+ * blocking calls).  Nested activations of the selected region are credited
+ * once per activation.  Only one causal profile may be active at a time.
+ *
+ * @note Requires linking with `-pthread`.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Maximum number of regions.  May be overridden. */
+#ifndef CTIMER_CAUSAL_REGIONS
+#define CTIMER_CAUSAL_REGIONS 32
+#endif
+
+/** Maximum number of progress points.  May be overridden. */
+#ifndef CTIMER_CAUSAL_POINTS
+#define CTIMER_CAUSAL_POINTS 8
+#endif
+
+/** Virtual speedup step (percent; divides 100).  May be overridden. */
+#ifndef CTIMER_CAUSAL_STEP
+#define CTIMER_CAUSAL_STEP 25
+#endif
+
+/** Shortest pause (nsec); smaller shortfalls are paid later.  May be
+ * overridden. */
+#ifndef CTIMER_CAUSAL_MIN_PAUSE
+#define CTIMER_CAUSAL_MIN_PAUSE 20000
+#endif
+
+/* number of speedup levels, including 0 */
+#define _CTIMER_CAUSAL_LEVELS (100 / CTIMER_CAUSAL_STEP + 1)
+
+
+/**
+ * Progress point.
+ */
+typedef struct {
+    char const    * name;       /**< Point name */
+    unsigned long   count;      /**< Laps (units of work completed) */
+    long            lat_sum;    /**< Sum of virtual latencies (nsec) */
+    unsigned long   lat_n;      /**< Laps with latency */
+} ctimer_causal_point_t;
+
+
+/**
+ * Accumulated results of the experiments with one region and speedup.
+ */
+typedef struct {
+    unsigned long   runs;                           /**< Experiments */
+    double          time;                           /**< Effective nsec */
+    double          count[CTIMER_CAUSAL_POINTS];    /**< Progress laps */
+    double          lat_sum[CTIMER_CAUSAL_POINTS];  /**< Latency sums */
+    double          lat_n[CTIMER_CAUSAL_POINTS];    /**< Latency laps */
+} ctimer_causal_cell_t;
+
+
+/**
+ * Causal profile: regions, progress points, experiment state, and results.
+ */
+typedef struct {
+    char const            * regions[CTIMER_CAUSAL_REGIONS]; /**< Names */
+    unsigned long           visits[CTIMER_CAUSAL_REGIONS];  /**< Activations */
+    ctimer_causal_point_t   points[CTIMER_CAUSAL_POINTS];   /**< Progress */
+    int                     nregions;   /**< Number of regions */
+    int                     npoints;    /**< Number of progress points */
+    long                    experiment; /**< Experiment duration (nsec) */
+    unsigned int            seed;       /**< Experiment selection seed */
+    int                     selected;   /**< Selected region, or -1 */
+    long                    speedup;    /**< Selected speedup (percent) */
+    long                    delay;      /**< Global delay count (nsec) */
+    int                     stop;       /**< Stop the driver? */
+    pthread_t               driver;     /**< Driver thread */
+    ctimer_causal_cell_t    results[CTIMER_CAUSAL_REGIONS]
+                                   [_CTIMER_CAUSAL_LEVELS]; /**< Results */
+} ctimer_causal_t;
+
+
+/* calling thread's delay count; < 0 until first synchronized (weak, so all
+ * translation units share it) */
+__attribute__((weak)) __thread long _ctimer_causal_local = -1;
+
+
+/**
+ * Initialize causal profile `c` with experiments of `experiment` nsec.
+ */
+static inline
+void ctimer_causal_init(
+    ctimer_causal_t * c,        /**<[out] causal profile */
+    long              experiment /**<[in] experiment duration (nsec) */
+) {
+    memset(c, 0, sizeof(*c));
+    c->experiment = experiment;
+    c->seed       = 1;
+    c->selected   = -1;
+}
+
+
+/**
+ * Register region `name`.
+ *
+ * @return region identifier, or -1 if there are `CTIMER_CAUSAL_REGIONS`
+ */
+static inline
+int ctimer_causal_region(
+    ctimer_causal_t * c,        /**<[in,out] causal profile */
+    char const      * name      /**<[in] region name (kept by pointer) */
+) {
+    if (c->nregions == CTIMER_CAUSAL_REGIONS)
+        return -1;
+    c->regions[c->nregions] = name;
+    return c->nregions++;
+}
+
+
+/**
+ * Register progress point `name`.
+ *
+ * @return point identifier, or -1 if there are `CTIMER_CAUSAL_POINTS`
+ */
+static inline
+int ctimer_causal_point(
+    ctimer_causal_t * c,        /**<[in,out] causal profile */
+    char const      * name      /**<[in] point name (kept by pointer) */
+) {
+    if (c->npoints == CTIMER_CAUSAL_POINTS)
+        return -1;
+    c->points[c->npoints].name = name;
+    return c->npoints++;
+}
+
+
+/**
+ * Pay the calling thread's delay shortfall: pause until its delay count
+ * catches up with the global count.
+ */
+static inline
+void ctimer_causal_sync(
+    ctimer_causal_t * c         /**<[in,out] causal profile */
+) {
+    long const g = __atomic_load_n(&c->delay, __ATOMIC_ACQUIRE);
+    long const d = g - _ctimer_causal_local;
+    struct timespec t0, t1, p;
+    if (_ctimer_causal_local < 0) {
+        _ctimer_causal_local = g;
+        return;
+    }
+    if (d < CTIMER_CAUSAL_MIN_PAUSE)
+        return;
+    p.tv_sec  = d / 1000000000L;
+    p.tv_nsec = d % 1000000000L;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    nanosleep(&p, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    /* oversleeping counts toward later delays */
+    _ctimer_causal_local += timespec_nsec(t1) - timespec_nsec(t0);
+}
+
+
+/**
+ * Forgive the calling thread's delay shortfall (e.g., after blocking on
+ * something other than an instrumented thread).
+ */
+static inline
+void ctimer_causal_skip(
+    ctimer_causal_t * c         /**<[in,out] causal profile */
+) {
+    _ctimer_causal_local = __atomic_load_n(&c->delay, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * Return the calling thread's virtual time (nsec): `CLOCK_MONOTONIC` minus
+ * the delays the thread has paused for or been credited with.  Synchronizes
+ * a thread that has not yet synchronized with the profile, so that delays
+ * inserted before are not subtracted from its later virtual times.
+ */
+static inline
+long ctimer_causal_now(
+    ctimer_causal_t * c         /**<[in,out] causal profile */
+) {
+    struct timespec t;
+    if (_ctimer_causal_local < 0)
+        _ctimer_causal_local = __atomic_load_n(&c->delay, __ATOMIC_ACQUIRE);
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return timespec_nsec(t) - _ctimer_causal_local;
+}
+
+
+/**
+ * Enter region `r`: pay delays, then start stopwatch `t`.
+ *
+ * @sa ctimer_causal_region_stop
+ */
+static inline
+void ctimer_causal_region_start(
+    ctimer_causal_t * c,        /**<[in,out] causal profile */
+    int               r,        /**<[in] region identifier */
+    ctimer_t        * t         /**<[in,out] stopwatch */
+) {
+    (void)r;
+    ctimer_causal_sync(c);
+    ctimer_start(t);
+}
+
+
+/**
+ * Exit region `r`: stop stopwatch `t` and, if `r` is the selected region,
+ * delay other threads by the virtual speedup of this activation.
+ *
+ * @sa ctimer_causal_region_start
+ */
+static inline
+void ctimer_causal_region_stop(
+    ctimer_causal_t * c,        /**<[in,out] causal profile */
+    int               r,        /**<[in] region identifier */
+    ctimer_t        * t         /**<[in,out] stopwatch */
+) {
+    ctimer_stop(t);
+    __atomic_fetch_add(&c->visits[r], 1, __ATOMIC_RELAXED);
+    /* acquire pairs with the release store of `selected`, so the speedup
+     * read below is the one published for this experiment */
+    if (__atomic_load_n(&c->selected, __ATOMIC_ACQUIRE) == r) {
+        long const s = __atomic_load_n(&c->speedup, __ATOMIC_RELAXED);
+        long const x = (timespec_nsec(t->end) - timespec_nsec(t->start))
+            * s / 100;
+        if (_ctimer_causal_local < 0)
+            ctimer_causal_sync(c);
+        /* the thread itself is "sped up": credit it, and delay others */
+        _ctimer_causal_local += x;
+        __atomic_fetch_add(&c->delay, x, __ATOMIC_RELEASE);
+    }
+    ctimer_causal_sync(c);
+}
+
+
+/**
+ * Count one lap of progress point `p`.
+ */
+static inline
+void ctimer_causal_progress(
+    ctimer_causal_t * c,        /**<[in,out] causal profile */
+    int               p         /**<[in] point identifier */
+) {
+    __atomic_fetch_add(&c->points[p].count, 1, __ATOMIC_RELAXED);
+    ctimer_causal_sync(c);
+}
+
+
+/**
+ * Count one lap of progress point `p`, for work started on the calling
+ * thread at virtual time `t0` (from `ctimer_causal_now()`).
+ */
+static inline
+void ctimer_causal_latency(
+    ctimer_causal_t * c,        /**<[in,out] causal profile */
+    int               p,        /**<[in] point identifier */
+    long              t0        /**<[in] virtual start time (nsec) */
+) {
+    __atomic_fetch_add(&c->points[p].lat_sum, ctimer_causal_now(c) - t0,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->points[p].lat_n, 1, __ATOMIC_RELAXED);
+    ctimer_causal_progress(c, p);
+}
+
+
+/* run experiments until stopped */
+static inline
+void * _ctimer_causal_driver(
+    void * arg
+) {
+    ctimer_causal_t * c = (ctimer_causal_t *)arg;
+    unsigned long     count[CTIMER_CAUSAL_POINTS];
+    unsigned long     lat_n[CTIMER_CAUSAL_POINTS];
+    long              lat_sum[CTIMER_CAUSAL_POINTS];
+    while (!__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE)) {
+        int const r     = rand_r(&c->seed) % c->nregions;
+        int const level = (rand_r(&c->seed) % 2)
+            ? 1 + rand_r(&c->seed) % (_CTIMER_CAUSAL_LEVELS - 1) : 0;
+        unsigned long const v0 = __atomic_load_n(&c->visits[r],
+                                                 __ATOMIC_RELAXED);
+        ctimer_causal_cell_t * cell = &c->results[r][level];
+        struct timespec t0, t1, slice;
+        long d0, d1, left;
+        int  p;
+
+        for (p = 0; p < c->npoints; ++p) {
+            count[p]   = __atomic_load_n(&c->points[p].count, __ATOMIC_RELAXED);
+            lat_n[p]   = __atomic_load_n(&c->points[p].lat_n, __ATOMIC_RELAXED);
+            lat_sum[p] = __atomic_load_n(&c->points[p].lat_sum,
+                                         __ATOMIC_RELAXED);
+        }
+        d0 = __atomic_load_n(&c->delay, __ATOMIC_ACQUIRE);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        __atomic_store_n(&c->speedup, (long)level * CTIMER_CAUSAL_STEP,
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&c->selected, r, __ATOMIC_RELEASE);
+
+        /* sleep in slices, so that stopping is prompt */
+        for (left = c->experiment; left > 0; left -= 10000000L) {
+            if (__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE))
+                break;
+            slice.tv_sec  = 0;
+            slice.tv_nsec = (left < 10000000L) ? left : 10000000L;
+            nanosleep(&slice, NULL);
+        }
+
+        __atomic_store_n(&c->selected, -1, __ATOMIC_RELEASE);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        d1 = __atomic_load_n(&c->delay, __ATOMIC_ACQUIRE);
+        /* discard interrupted experiments, and speedups of regions that did
+         * not run (they measure nothing) */
+        if ((left > 0) ||
+            ((level > 0) &&
+             (__atomic_load_n(&c->visits[r], __ATOMIC_RELAXED) == v0)))
+            continue;
+        cell->runs++;
+        cell->time += (timespec_nsec(t1) - timespec_nsec(t0)) - (d1 - d0);
+        for (p = 0; p < c->npoints; ++p) {
+            ctimer_causal_point_t * pt = &c->points[p];
+            cell->count[p]   += __atomic_load_n(&pt->count, __ATOMIC_RELAXED)
+                - count[p];
+            cell->lat_n[p]   += __atomic_load_n(&pt->lat_n, __ATOMIC_RELAXED)
+                - lat_n[p];
+            cell->lat_sum[p] += __atomic_load_n(&pt->lat_sum, __ATOMIC_RELAXED)
+                - lat_sum[p];
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Start running experiments in a driver thread.
+ *
+ * @return 0 on success, or an error number
+ */
+static inline
+int ctimer_causal_begin(
+    ctimer_causal_t * c         /**<[in,out] causal profile */
+) {
+    if (c->nregions == 0)
+        return EINVAL;
+    __atomic_store_n(&c->stop, 0, __ATOMIC_RELEASE);
+    return pthread_create(&c->driver, NULL, _ctimer_causal_driver, c);
+}
+
+
+/**
+ * Stop running experiments (discarding the current one).
+ */
+static inline
+void ctimer_causal_end(
+    ctimer_causal_t * c         /**<[in,out] causal profile */
+) {
+    __atomic_store_n(&c->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(c->driver, NULL);
+}
+
+
+/**
+ * Print the optimization opportunities of progress point `p`: regions
+ * ranked by estimated throughput gain.
+ *
+ * Lines are printed as:
+ * ```
+ * Causal(<point>) = baseline X/s, latency Y nsec (N experiments)
+ * Causal(<point>, <region>) = slope S; +25%: G% (L%) ... [N]
+ * ```
+ * where `S` is the relative throughput gain per unit of speedup (e.g., 0.4:
+ * speeding the region up by 10% would raise throughput by 4%), and `G` and
+ * `L` are the relative throughput and latency changes at each speedup
+ * (`?` without experiments), and the line ends with the number of speedup
+ * experiments of the region in brackets.  Baseline experiments of all
+ * regions are pooled.
+ */
+static inline
+void ctimer_causal_print(
+    ctimer_causal_t const * c,  /**<[in] causal profile */
+    int                     p   /**<[in] point identifier */
+) {
+    double base_rate, base_lat, base_t = 0, base_n = 0, base_ls = 0,
+           base_ln = 0;
+    double slope[CTIMER_CAUSAL_REGIONS];
+    int    order[CTIMER_CAUSAL_REGIONS];
+    long   runs = 0;
+    int    r, i, j, l;
+
+    for (r = 0; r < c->nregions; ++r) {
+        ctimer_causal_cell_t const * b = &c->results[r][0];
+        base_t  += b->time;
+        base_n  += b->count[p];
+        base_ls += b->lat_sum[p];
+        base_ln += b->lat_n[p];
+        runs    += b->runs;
+    }
+    base_rate = (base_t > 0) ? base_n / base_t * 1e9 : 0;
+    base_lat  = (base_ln > 0) ? base_ls / base_ln : 0;
+    printf("Causal(%s) = baseline %.1f/s, latency %.0f nsec"
+           " (%ld experiments)\n", c->points[p].name, base_rate, base_lat,
+           runs);
+    if (base_rate == 0)
+        return;
+
+    /* least-squares slope (through the origin) of gain vs. speedup */
+    for (r = 0; r < c->nregions; ++r) {
+        double sg = 0, ss = 0;
+        for (l = 1; l < _CTIMER_CAUSAL_LEVELS; ++l) {
+            ctimer_causal_cell_t const * x = &c->results[r][l];
+            double const s = l * CTIMER_CAUSAL_STEP / 100.0;
+            if ((x->runs == 0) || (x->time <= 0))
+                continue;
+            sg += s * (x->count[p] / x->time * 1e9 / base_rate - 1);
+            ss += s * s;
+        }
+        slope[r] = (ss > 0) ? sg / ss : 0;
+        /* insertion sort, by decreasing slope */
+        for (i = r; (i > 0) && (slope[order[i-1]] < slope[r]); --i)
+            order[i] = order[i-1];
+        order[i] = r;
+    }
+
+    for (i = 0; i < c->nregions; ++i) {
+        r = order[i];
+        printf("Causal(%s, %s) = slope %+.2f;", c->points[p].name,
+               c->regions[r], slope[r]);
+        for (l = 1; l < _CTIMER_CAUSAL_LEVELS; ++l) {
+            ctimer_causal_cell_t const * x = &c->results[r][l];
+            printf(" +%d%%: ", l * CTIMER_CAUSAL_STEP);
+            if ((x->runs == 0) || (x->time <= 0)) {
+                printf("?");
+                continue;
+            }
+            printf("%+.1f%%", 100 * (x->count[p] / x->time * 1e9 / base_rate
+                                     - 1));
+            if ((base_lat > 0) && (x->lat_n[p] > 0))
+                printf(" (%+.1f%%)",
+                       100 * (x->lat_sum[p] / x->lat_n[p] / base_lat - 1));
+        }
+        for (j = 0, l = 1; l < _CTIMER_CAUSAL_LEVELS; ++l)
+            j += (int)c->results[r][l].runs;
+        printf(" [%d]\n", j);
+    }
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_causal */
+
+
+#endif  /* __H_CTIMER_CAUSAL__ */
@@ -0,0 +1,293 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Background-updated cached clock for coarse-grain CTimer timestamps.
+ *
+ * @file        ctimer_clockcache.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_CLOCKCACHE__
+#define __H_CTIMER_CLOCKCACHE__
+
+
+#include <time.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_clockcache Cached clock API
+ * @ingroup ctimer
+ *
+ * Approximate "now" maintained by a service thread.
+ *
+ * A `ctimer_clockcache_t` cached clock holds a `CLOCK_MONOTONIC` timestamp (in
+ * nsec) on its own cache line, which a service thread refreshes every
+ * `period` usec.  Readers perform a single relaxed atomic load instead of a
+ * clock read.  The service thread also tracks the largest observed gap between
+ * consecutive updates; this is the staleness bound of any cached timestamp,
+ * and is reported next to measurements taken with the cached clock.
+ *
+ * `ctimer_start_cached()` and `ctimer_stop_cached()` use the cached clock as
+ * the time source of a `ctimer_t` stopwatch.
+ *
+ * @note Programs using the cached clock must be compiled with `-pthread`.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Cache line size assumed for padding. */
+#ifndef CTIMER_CACHELINE
+#define CTIMER_CACHELINE 64
+#endif
+
+
+/**
+ * Cached clock struct.
+ *
+ * @note The cached timestamp is isolated on its own cache line only if the
+ * struct itself is cache-line aligned; static and automatic objects are
+ * aligned by the compiler, but heap-allocated ones need `aligned_alloc()` or
+ * `posix_memalign()`.
+ */
+typedef struct {
+    long   now __attribute__((aligned(CTIMER_CACHELINE)));
+                                /**< Cached `CLOCK_MONOTONIC` time (nsec) */
+    char   _pad[CTIMER_CACHELINE - sizeof(long)];
+    long   period;              /**< Update period (nsec) */
+    long   max_gap;             /**< Largest observed update gap (nsec) */
+    int    stop;                /**< Service thread stop flag */
+    pthread_t thread;           /**< Service thread */
+} ctimer_clockcache_t;
+
+
+/* read CLOCK_MONOTONIC in nsec */
+static inline
+long _ctimer_clockcache_read(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_nsec(ts);
+}
+
+
+/* service thread: refresh the cached time at absolute deadlines */
+static inline
+void * _ctimer_clockcache_main(
+    void * arg
+) {
+    ctimer_clockcache_t * cc = (ctimer_clockcache_t *)arg;
+    struct timespec       deadline;
+    long                  prev = __atomic_load_n(&cc->now, __ATOMIC_RELAXED);
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (!__atomic_load_n(&cc->stop, __ATOMIC_ACQUIRE)) {
+        struct timespec const step = {0, cc->period};
+        long                  now;
+        long                  gap;
+
+        timespec_add(&deadline, deadline, step);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        now = _ctimer_clockcache_read();
+        __atomic_store_n(&cc->now, now, __ATOMIC_RELAXED);
+
+        gap = now - prev;
+        if (gap > __atomic_load_n(&cc->max_gap, __ATOMIC_RELAXED))
+            __atomic_store_n(&cc->max_gap, gap, __ATOMIC_RELAXED);
+        prev = now;
+
+        /* skip missed deadlines instead of bursting to catch up */
+        if (timespec_nsec(deadline) < now)
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+    }
+    return NULL;
+}
+
+
+/**
+ * Initialize a cached clock and start its service thread, which refreshes the
+ * cached time every `period_usec` usec (at most 1 sec).
+ *
+ * @return 0 on success, or an error number from `pthread_create()`
+ *
+ * @sa ctimer_clockcache_stop
+ */
+static inline
+int ctimer_clockcache_start(
+    ctimer_clockcache_t * cc,         /**<[out] cached clock */
+    long          const   period_usec /**<[in]  update period (usec) */
+) {
+    long usec = period_usec;
+    if (usec < 1)
+        usec = 1;
+    else if (usec >= _USEC_PER_SEC)
+        usec = _USEC_PER_SEC - 1;
+    cc->period  = usec * _MSEC_PER_SEC;
+    cc->max_gap = cc->period;
+    cc->stop    = 0;
+    cc->now     = _ctimer_clockcache_read();
+    return pthread_create(&cc->thread, NULL, _ctimer_clockcache_main, cc);
+}
+
+
+/**
+ * Stop the service thread of a cached clock.  The cached time stops advancing.
+ *
+ * @sa ctimer_clockcache_start
+ */
+static inline
+void ctimer_clockcache_stop(
+    ctimer_clockcache_t * cc    /**<[in,out] cached clock */
+) {
+    __atomic_store_n(&cc->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(cc->thread, NULL);
+}
+
+
+/**
+ * Return the cached time in nsec, with a single relaxed load.
+ */
+static inline
+long ctimer_clockcache_nsec(
+    ctimer_clockcache_t const * cc /**<[in] cached clock */
+) {
+    return __atomic_load_n(&cc->now, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Return the cached time as a `timespec`, with a single relaxed load.
+ */
+static inline
+struct timespec ctimer_clockcache_now(
+    ctimer_clockcache_t const * cc /**<[in] cached clock */
+) {
+    long const      ns = ctimer_clockcache_nsec(cc);
+    struct timespec ts;
+    ts.tv_sec  = ns / _NSEC_PER_SEC;
+    ts.tv_nsec = ns % _NSEC_PER_SEC;
+    return ts;
+}
+
+
+/**
+ * Return the staleness bound of the cached clock: the largest observed gap
+ * between consecutive updates (at least the update period).
+ */
+static inline
+struct timespec ctimer_clockcache_staleness(
+    ctimer_clockcache_t const * cc /**<[in] cached clock */
+) {
+    long const      ns = __atomic_load_n(&cc->max_gap, __ATOMIC_RELAXED);
+    struct timespec ts;
+    ts.tv_sec  = ns / _NSEC_PER_SEC;
+    ts.tv_nsec = ns % _NSEC_PER_SEC;
+    return ts;
+}
+
+
+/**
+ * Start a `ctimer_t` stopwatch at the cached time.
+ *
+ * @sa ctimer_start
+ */
+static inline
+void ctimer_start_cached(
+    ctimer_t                  * t, /**<[in,out] stopwatch pointer */
+    ctimer_clockcache_t const * cc /**<[in]     cached clock */
+) {
+    ctimer_start_at(t, ctimer_clockcache_now(cc));
+}
+
+
+/**
+ * Stop a `ctimer_t` stopwatch at the cached time.
+ *
+ * @sa ctimer_stop
+ */
+static inline
+void ctimer_stop_cached(
+    ctimer_t                  * t, /**<[in,out] stopwatch pointer */
+    ctimer_clockcache_t const * cc /**<[in]     cached clock */
+) {
+    ctimer_stop_at(t, ctimer_clockcache_now(cc));
+}
+
+
+/**
+ * Print a line with the `elapsed` time of a `ctimer_t` stopwatch measured with
+ * a cached clock, together with the clock's staleness bound.
+ *
+ * The line is printed as:
+ * ```
+ * Time(<label>) = XX.XXXXXXXXX sec (cached, staleness <= YY.YYYYYYYYY sec)
+ * ```
+ *
+ * @sa ctimer_print
+ */
+static inline
+void ctimer_print_cached(
+    ctimer_t            const   t,     /**<[in] stopwatch */
+    char                const * label, /**<[in] label/description */
+    ctimer_clockcache_t const * cc     /**<[in] cached clock */
+) {
+    struct timespec const stale = ctimer_clockcache_staleness(cc);
+
+    if ((label != NULL) && (label[0] != '\0'))
+        printf("Time(%s) = ", label);
+    else
+        printf("Time = ");
+
+    printf("%ld.%09ld sec (cached, staleness <= %ld.%09ld sec)\n",
+           (long)t.elapsed.tv_sec, t.elapsed.tv_nsec,
+           (long)stale.tv_sec, stale.tv_nsec);
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_clockcache */
+
+
+#endif  /* __H_CTIMER_CLOCKCACHE__ */
@@ -0,0 +1,392 @@
+/* -*- c -*- */
+
+/**
+ * CTimer cyclictest: scheduling (wake-up) latency and jitter of periodic
+ * threads, measured with the CTimer clock.
+ *
+ * One thread per CPU (or per `-t` thread) is pinned to its CPU and sleeps to
+ * absolute deadlines `interval` apart with `clock_nanosleep(TIMER_ABSTIME)`;
+ * each wake-up latency (actual minus intended wake-up time) is recorded in a
+ * per-thread histogram, and every deadline and wake-up in a per-thread trace
+ * ring.  The report lists per-CPU latency statistics, their aggregate, and the
+ * worst wake-ups together with a trace snapshot of the preceding cycles.
+ *
+ * Build and run with:
+ * ```
+ * gcc -O2 -std=gnu99 ctimer_cyclictest.c -o ctimer_cyclictest -pthread
+ * ./ctimer_cyclictest [-t threads] [-i usec] [-l loops | -D sec]
+ *                     [-p prio] [-b] [-m] [-w worst] [-H]
+ * ```
+ *
+ * | Option       | Meaning                                                   |
+ * |--------------|-----------------------------------------------------------|
+ * | `-t threads` | number of threads (default: one per allowed CPU)          |
+ * | `-i usec`    | wake-up interval (default 1000)                           |
+ * | `-l loops`   | cycles per thread (default 10000)                         |
+ * | `-D sec`     | run for `sec` seconds instead of `-l` cycles              |
+ * | `-p prio`    | run threads with `SCHED_FIFO` priority `prio`, if allowed |
+ * | `-b`         | busy-poll the clock until each deadline (no sleeping)     |
+ * | `-m`         | lock memory with `mlockall()`                             |
+ * | `-w worst`   | number of worst wake-ups to report (default 5)            |
+ * | `-H`         | also print the aggregate histogram buckets                |
+ *
+ * @file        ctimer_cyclictest.c
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ctimer.h"
+#include "ctimer_trace.h"
+#include "ctimer_hist.h"
+
+
+/* cycles of trace context kept with each worst wake-up (2 events per cycle) */
+#define CONTEXT_CYCLES 8
+
+/* most worst wake-ups tracked per thread */
+#define MAX_WORST 64
+
+
+/* one of the worst wake-ups of a thread */
+typedef struct {
+    long           latency;     /* nsec */
+    long           loop;        /* cycle index */
+    size_t         nev;         /* events in `ev` */
+    ctimer_event_t ev[2 * CONTEXT_CYCLES];
+} worst_t;
+
+
+/* per-thread state and results */
+typedef struct {
+    pthread_t      tid;
+    int            cpu;         /* CPU the thread is pinned to */
+    int            fifo;        /* 1 if running with SCHED_FIFO */
+    long           overruns;    /* wake-ups later than a full interval */
+    long           min;         /* smallest latency (nsec) */
+    long           floor;       /* smallest kept worst latency, once full */
+    ctimer_hist_t  hist;
+    ctimer_trace_t trace;
+    int            nworst;
+    worst_t        worst[MAX_WORST];
+} thread_t;
+
+
+/* run options */
+static long interval = 1000000;  /* nsec */
+static long loops    = 10000;
+static int  prio     = 0;
+static int  busy     = 0;
+static int  nreport  = 5;
+
+
+/* keep `latency` among the thread's `nreport` worst, with a trace snapshot of
+ * the preceding cycles */
+static void keep_worst(thread_t * th, long const latency, long const loop) {
+    worst_t * w;
+    int       i;
+
+    if (th->nworst < nreport)
+        w = &th->worst[th->nworst++];
+    else {
+        w = &th->worst[0];
+        for (i = 1; i < th->nworst; ++i)
+            if (th->worst[i].latency < w->latency)
+                w = &th->worst[i];
+    }
+    w->latency = latency;
+    w->loop    = loop;
+    w->nev     = ctimer_trace_snapshot(&th->trace, w->ev, 2 * CONTEXT_CYCLES);
+    if (th->nworst == nreport) {
+        th->floor = th->worst[0].latency;
+        for (i = 1; i < th->nworst; ++i)
+            if (th->worst[i].latency < th->floor)
+                th->floor = th->worst[i].latency;
+    }
+}
+
+
+/* advance `t` by `ns` nsec */
+static void advance(struct timespec * t, long const ns) {
+    struct timespec const d = {ns / 1000000000L, ns % 1000000000L};
+    timespec_add(t, *t, d);
+}
+
+
+/* wait until `deadline` by sleeping or busy-polling */
+static void wait_until(struct timespec const * deadline) {
+    if (busy) {
+        long const      d = timespec_nsec(*deadline);
+        struct timespec now;
+        do
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        while (timespec_nsec(now) < d);
+    } else {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL)
+               == EINTR)
+            ;
+    }
+}
+
+
+/* periodic thread: a stopwatch started at each deadline and stopped at
+ * wake-up measures the wake-up latency */
+static void * cyclic(void * arg) {
+    thread_t      * th = (thread_t *)arg;
+    struct timespec next;
+    ctimer_t        t;
+    long            i, lat;
+
+    ctimer_reset(&t);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i = 0; i < loops; ++i) {
+        advance(&next, interval);
+        wait_until(&next);
+        ctimer_start_at(&t, next);
+        ctimer_stop(&t);
+        lat = timespec_nsec(t.end) - timespec_nsec(t.start);
+
+        ctimer_trace_append(&th->trace, CTIMER_EVENT_START, (unsigned)i,
+                            timespec_nsec(t.start));
+        ctimer_trace_append(&th->trace, CTIMER_EVENT_STOP, (unsigned)i,
+                            timespec_nsec(t.end));
+        ctimer_hist_record(&th->hist, lat);
+        if ((th->min < 0) || (lat < th->min))
+            th->min = lat;
+        if (lat > th->floor)
+            keep_worst(th, lat, i);
+
+        /* skip deadlines missed entirely instead of waking back-to-back */
+        if (lat >= interval) {
+            long const missed = lat / interval;
+            th->overruns += missed;
+            i += missed;
+            advance(&next, missed * interval);
+        }
+    }
+    return NULL;
+}
+
+
+/* start a thread pinned to its CPU, with SCHED_FIFO priority if requested and
+ * permitted */
+static int spawn(thread_t * th) {
+    pthread_attr_t     attr;
+    cpu_set_t          set;
+    struct sched_param sp;
+    int                err;
+
+    pthread_attr_init(&attr);
+    CPU_ZERO(&set);
+    CPU_SET(th->cpu, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    if (prio > 0) {
+        sp.sched_priority = prio;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &sp);
+    }
+    err = pthread_create(&th->tid, &attr, cyclic, th);
+    th->fifo = (prio > 0) && (err == 0);
+    if ((err == EPERM) && (prio > 0)) {
+        fprintf(stderr, "cpu%d: SCHED_FIFO not permitted;"
+                " running with default policy\n", th->cpu);
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        err = pthread_create(&th->tid, &attr, cyclic, th);
+    }
+    pthread_attr_destroy(&attr);
+    return err;
+}
+
+
+/* print the min/avg/max line of a histogram */
+static void print_summary(char const * label, ctimer_hist_t const * h,
+                          long const min, long const overruns) {
+    printf("Latency(%s) = min/avg/max %ld/%ld/%ld nsec; %ld overruns\n", label,
+           min, (h->count > 0) ? h->sum / (long)h->count : 0, h->max,
+           overruns);
+    ctimer_hist_print(h, label);
+}
+
+
+/* order worst wake-ups by decreasing latency */
+typedef struct {
+    worst_t const * w;
+    int             cpu;
+} ranked_t;
+
+static int by_latency(void const * a, void const * b) {
+    long const la = ((ranked_t const *)a)->w->latency;
+    long const lb = ((ranked_t const *)b)->w->latency;
+    return (la < lb) - (la > lb);
+}
+
+
+static void usage(char const * prog) {
+    fprintf(stderr, "usage: %s [-t threads] [-i usec] [-l loops | -D sec]"
+            " [-p prio] [-b] [-m] [-w worst] [-H]\n", prog);
+    exit(1);
+}
+
+
+int main(int argc, char ** argv) {
+    cpu_set_t      allowed;
+    int            cpus[CPU_SETSIZE];   /* allowed CPU ids */
+    int            ncpus    = 0;
+    thread_t     * ths;
+    ranked_t     * ranked;
+    ctimer_hist_t  all;
+    int            nthreads = 0;
+    int            buckets  = 0;
+    double         duration = 0;
+    long           min      = -1;
+    long           overruns = 0;
+    int            nranked  = 0;
+    int            opt, i, j;
+
+    while ((opt = getopt(argc, argv, "t:i:l:D:p:bmw:H")) != -1) {
+        switch (opt) {
+        case 't': nthreads = atoi(optarg);              break;
+        case 'i': interval = atol(optarg) * 1000;       break;
+        case 'l': loops    = atol(optarg);              break;
+        case 'D': duration = atof(optarg);              break;
+        case 'p': prio     = atoi(optarg);              break;
+        case 'b': busy     = 1;                         break;
+        case 'm':
+            if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+                perror("mlockall");
+            break;
+        case 'w': nreport  = atoi(optarg);              break;
+        case 'H': buckets  = 1;                         break;
+        default:  usage(argv[0]);
+        }
+    }
+    if ((interval <= 0) || (loops <= 0) || (nreport < 0))
+        usage(argv[0]);
+    if (nreport > MAX_WORST)
+        nreport = MAX_WORST;
+    if (duration > 0)
+        loops = (long)(duration * 1e9 / (double)interval);
+
+    /* one thread per allowed CPU by default; more threads wrap around */
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("sched_getaffinity");
+        return 1;
+    }
+    for (i = 0; i < CPU_SETSIZE; ++i)
+        if (CPU_ISSET(i, &allowed))
+            cpus[ncpus++] = i;
+    if (nthreads <= 0)
+        nthreads = ncpus;
+    ths = (thread_t *)calloc((size_t)nthreads, sizeof(thread_t));
+    if (ths == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    for (i = 0; i < nthreads; ++i) {
+        ths[i].cpu   = cpus[i % ncpus];
+        ths[i].min   = -1;
+        ths[i].floor = (nreport > 0) ? -1 : LONG_MAX;
+        if ((ctimer_hist_init(&ths[i].hist, 0) != 0)
+            || (ctimer_trace_init(&ths[i].trace, 4 * CONTEXT_CYCLES, 0) != 0)) {
+            fprintf(stderr, "buffer allocation failed\n");
+            return 1;
+        }
+    }
+
+    printf("%d threads, interval %ld usec, %ld loops, %s%s\n", nthreads,
+           interval / 1000, loops, busy ? "busy-poll" : "clock_nanosleep",
+           (prio > 0) ? ", SCHED_FIFO" : "");
+    for (i = 0; i < nthreads; ++i)
+        if (spawn(&ths[i]) != 0) {
+            fprintf(stderr, "cpu%d: cannot create thread\n", ths[i].cpu);
+            return 1;
+        }
+    for (i = 0; i < nthreads; ++i)
+        pthread_join(ths[i].tid, NULL);
+
+    /* per-CPU and aggregate latency */
+    if (ctimer_hist_init(&all, CTIMER_BUF_NO_HUGE) != 0) {
+        fprintf(stderr, "buffer allocation failed\n");
+        return 1;
+    }
+    for (i = 0; i < nthreads; ++i) {
+        char label[32];
+        snprintf(label, sizeof(label), "cpu%d%s", ths[i].cpu,
+                 ths[i].fifo ? ",fifo" : "");
+        print_summary(label, &ths[i].hist, ths[i].min, ths[i].overruns);
+        ctimer_hist_merge(&all, &ths[i].hist);
+        if ((min < 0) || ((ths[i].min >= 0) && (ths[i].min < min)))
+            min = ths[i].min;
+        overruns += ths[i].overruns;
+    }
+    print_summary("all", &all, min, overruns);
+    if (buckets)
+        ctimer_hist_print_buckets(&all);
+
+    /* worst wake-ups over all threads, with their trace context */
+    ranked = (ranked_t *)malloc((size_t)(nthreads * MAX_WORST)
+                                * sizeof(ranked_t));
+    for (i = 0; (ranked != NULL) && (i < nthreads); ++i)
+        for (j = 0; j < ths[i].nworst; ++j) {
+            ranked[nranked].w   = &ths[i].worst[j];
+            ranked[nranked].cpu = ths[i].cpu;
+            ++nranked;
+        }
+    if (nranked > 0)
+        qsort(ranked, (size_t)nranked, sizeof(ranked_t), by_latency);
+    for (i = 0; (i < nranked) && (i < nreport); ++i) {
+        printf("\nWorst(%d: cpu%d, loop %ld) = %ld nsec\n", i + 1,
+               ranked[i].cpu, ranked[i].w->loop, ranked[i].w->latency);
+        ctimer_trace_print(ranked[i].w->ev, ranked[i].w->nev);
+    }
+
+    free(ranked);
+    ctimer_hist_destroy(&all);
+    for (i = 0; i < nthreads; ++i) {
+        ctimer_hist_destroy(&ths[i].hist);
+        ctimer_trace_destroy(&ths[i].trace);
+    }
+    free(ths);
+    return 0;
+}
@@ -0,0 +1,456 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Per-section energy measurement with RAPL counters for CTimer stopwatches.
+ *
+ * @file        ctimer_energy.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_ENERGY__
+#define __H_CTIMER_ENERGY__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_energy Energy API
+ * @ingroup ctimer
+ *
+ * Joules and average watts of timed sections, from Intel RAPL package energy
+ * counters.
+ *
+ * A `ctimer_energy_src_t` energy source opens the package-level RAPL counters
+ * once, via the powercap interface
+ * (`/sys/class/powercap/intel-rapl:N/energy_uj`) or, if that is not readable,
+ * via the `MSR_PKG_ENERGY_STATUS` model-specific register
+ * (`/dev/cpu/N/msr`).  If neither is available (e.g., in containers or on
+ * non-Intel hosts), the source is marked unavailable and energy stopwatches
+ * only measure time.
+ *
+ * A `ctimer_energy_t` energy stopwatch times every lap like a `ctimer_t`, but
+ * reads the energy counters only once per window of `batch` laps, since each
+ * read is a system call.  Counter wraparound is handled per window.  The
+ * average power over all windows is reported next to the elapsed time, and
+ * the energy of the timed laps is estimated as average power times elapsed
+ * time (for `batch` = 1 this is exactly the measured energy).
+ *
+ * @note RAPL counters measure whole packages, including other processes, and
+ * update about every millisecond; measure sections (or batches) that are
+ * substantially longer than that.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Maximum number of RAPL packages tracked.  May be overridden. */
+#ifndef CTIMER_ENERGY_MAX_ZONES
+#define CTIMER_ENERGY_MAX_ZONES 8
+#endif
+
+
+/**
+ * Energy counter interfaces.
+ */
+enum {
+    CTIMER_ENERGY_NONE     = 0, /**< Energy counters unavailable */
+    CTIMER_ENERGY_POWERCAP = 1, /**< Linux powercap sysfs interface */
+    CTIMER_ENERGY_MSR      = 2  /**< `MSR_PKG_ENERGY_STATUS` via msr driver */
+};
+
+
+/**
+ * RAPL energy source: open counter files, one per package.
+ */
+typedef struct {
+    int                kind;                           /**< `CTIMER_ENERGY_*` */
+    int                nzones;                         /**< Number of packages */
+    int                fd[CTIMER_ENERGY_MAX_ZONES];    /**< Counter files */
+    unsigned long long range[CTIMER_ENERGY_MAX_ZONES]; /**< Wraparound range */
+    double             unit;                           /**< Joules per count */
+} ctimer_energy_src_t;
+
+
+/**
+ * Energy stopwatch struct.
+ */
+typedef struct {
+    ctimer_t                    t;       /**< Timed laps */
+    ctimer_energy_src_t const * src;     /**< Energy source */
+    unsigned                    batch;   /**< Laps per energy window */
+    unsigned                    pending; /**< Laps in the open window */
+    struct timespec             w_start; /**< Open window start time */
+    unsigned long long          e_start[CTIMER_ENERGY_MAX_ZONES];
+                                         /**< Open window start counters */
+    unsigned char               e_valid[CTIMER_ENERGY_MAX_ZONES];
+                                         /**< Start counter read? */
+    unsigned long               skipped; /**< Zone windows not measured */
+    double                      joules;  /**< Energy over closed windows */
+    struct timespec             window;  /**< Duration of closed windows */
+} ctimer_energy_t;
+
+
+/* MSR addresses (Intel SDM vol. 4) */
+enum {
+    _CTIMER_MSR_RAPL_POWER_UNIT    = 0x606,
+    _CTIMER_MSR_PKG_ENERGY_STATUS  = 0x611
+};
+
+
+/* read one unsigned integer from a sysfs file */
+static inline
+int _ctimer_energy_read_ull(
+    char const         * path,
+    unsigned long long * val
+) {
+    char    buf[32];
+    ssize_t n;
+    int     fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    n = pread(fd, buf, sizeof(buf) - 1, 0);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+    *val = strtoull(buf, NULL, 10);
+    return 0;
+}
+
+
+/* open package-level powercap zones; returns number of zones opened */
+static inline
+int _ctimer_energy_open_powercap(
+    ctimer_energy_src_t * src
+) {
+    int i;
+    for (i = 0; i < CTIMER_ENERGY_MAX_ZONES; ++i) {
+        char               path[96];
+        unsigned long long range;
+        int                fd;
+        snprintf(path, sizeof(path),
+                 "/sys/class/powercap/intel-rapl:%d/max_energy_range_uj", i);
+        if (_ctimer_energy_read_ull(path, &range) != 0)
+            break;
+        snprintf(path, sizeof(path),
+                 "/sys/class/powercap/intel-rapl:%d/energy_uj", i);
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+            break;
+        src->fd[src->nzones]    = fd;
+        src->range[src->nzones] = range;
+        src->nzones++;
+    }
+    src->unit = 1e-6;           /* uJ */
+    return src->nzones;
+}
+
+
+/* open the msr device of the first CPU of each package */
+static inline
+int _ctimer_energy_open_msr(
+    ctimer_energy_src_t * src
+) {
+    int                seen[CTIMER_ENERGY_MAX_ZONES];
+    unsigned long long unit;
+    int                cpu;
+
+    for (cpu = 0; cpu < 4096 && src->nzones < CTIMER_ENERGY_MAX_ZONES; ++cpu) {
+        char               path[96];
+        unsigned long long pkg;
+        int                fd;
+        int                j;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+                 cpu);
+        if (_ctimer_energy_read_ull(path, &pkg) != 0)
+            break;
+        for (j = 0; (j < src->nzones) && (seen[j] != (int)pkg); ++j)
+            ;
+        if (j < src->nzones)
+            continue;
+        snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+            break;
+        if ((src->nzones == 0)
+            && (pread(fd, &unit, sizeof(unit), _CTIMER_MSR_RAPL_POWER_UNIT)
+                != (ssize_t)sizeof(unit))) {
+            close(fd);
+            break;
+        }
+        seen[src->nzones]       = (int)pkg;
+        src->fd[src->nzones]    = fd;
+        src->range[src->nzones] = 1ULL << 32;
+        src->nzones++;
+    }
+    if (src->nzones > 0)        /* energy status unit: bits 12:8 */
+        src->unit = 1.0 / (double)(1ULL << ((unit >> 8) & 0x1f));
+    return src->nzones;
+}
+
+
+/**
+ * Close any open counter files of an energy source.
+ */
+static inline
+void ctimer_energy_close(
+    ctimer_energy_src_t * src   /**<[in,out] energy source */
+) {
+    int i;
+    for (i = 0; i < src->nzones; ++i)
+        close(src->fd[i]);
+    src->nzones = 0;
+    src->kind   = CTIMER_ENERGY_NONE;
+}
+
+
+/**
+ * Open the RAPL package energy counters, preferring powercap over the msr
+ * driver.
+ *
+ * @return the `CTIMER_ENERGY_*` interface in use; `CTIMER_ENERGY_NONE` if
+ * energy counters are unavailable
+ */
+static inline
+int ctimer_energy_open(
+    ctimer_energy_src_t * src   /**<[out] energy source */
+) {
+    src->nzones = 0;
+    src->unit   = 0;
+    src->kind   = CTIMER_ENERGY_NONE;
+    if (_ctimer_energy_open_powercap(src) > 0) {
+        src->kind = CTIMER_ENERGY_POWERCAP;
+        return src->kind;
+    }
+    ctimer_energy_close(src);
+    if (_ctimer_energy_open_msr(src) > 0) {
+        src->kind = CTIMER_ENERGY_MSR;
+        return src->kind;
+    }
+    ctimer_energy_close(src);
+    return src->kind;
+}
+
+
+/* read the raw counter of package zone z; 0 on success */
+static inline
+int _ctimer_energy_read(
+    ctimer_energy_src_t const * src,
+    int                 const   z,
+    unsigned long long        * val
+) {
+    if (src->kind == CTIMER_ENERGY_MSR) {
+        if (pread(src->fd[z], val, sizeof(*val), _CTIMER_MSR_PKG_ENERGY_STATUS)
+            != (ssize_t)sizeof(*val))
+            return -1;
+        *val &= 0xffffffffULL;
+    } else {
+        char    buf[32];
+        ssize_t n = pread(src->fd[z], buf, sizeof(buf) - 1, 0);
+        if (n <= 0)
+            return -1;
+        buf[n] = '\0';
+        *val = strtoull(buf, NULL, 10);
+    }
+    return 0;
+}
+
+
+/**
+ * Initialize an energy stopwatch that reads the energy counters of `src` once
+ * every `batch` laps (at least 1).
+ */
+static inline
+void ctimer_energy_init(
+    ctimer_energy_t             * e,     /**<[out] energy stopwatch */
+    ctimer_energy_src_t const   * src,   /**<[in]  energy source */
+    unsigned              const   batch  /**<[in]  laps per energy window */
+) {
+    ctimer_reset(&e->t);
+    e->src     = src;
+    e->batch   = (batch > 0) ? batch : 1;
+    e->pending = 0;
+    e->joules  = 0;
+    e->skipped = 0;
+    e->window  = (struct timespec){0};
+}
+
+
+/**
+ * Start a lap of an energy stopwatch.  Reads the energy counters if the lap
+ * opens a new window.
+ *
+ * @sa ctimer_energy_stop
+ */
+static inline
+void ctimer_energy_start(
+    ctimer_energy_t * e         /**<[in,out] energy stopwatch */
+) {
+    if ((e->pending == 0) && (e->src->nzones > 0)) {
+        int z;
+        for (z = 0; z < e->src->nzones; ++z)
+            e->e_valid[z] =
+                (_ctimer_energy_read(e->src, z, &e->e_start[z]) == 0);
+        ctimer_start(&e->t);
+        e->w_start = e->t.start;
+    } else {
+        ctimer_start(&e->t);
+    }
+}
+
+
+/**
+ * Close the open energy window of an energy stopwatch, if any, at the end of
+ * its last lap.
+ */
+static inline
+void ctimer_energy_flush(
+    ctimer_energy_t * e         /**<[in,out] energy stopwatch */
+) {
+    ctimer_energy_src_t const * src = e->src;
+    int                         z;
+
+    if ((e->pending == 0) || (src->nzones == 0))
+        return;
+    for (z = 0; z < src->nzones; ++z) {
+        unsigned long long now;
+        unsigned long long delta;
+        /* a failed read at either end leaves no delta to add */
+        if (!e->e_valid[z] || (_ctimer_energy_read(src, z, &now) != 0)) {
+            e->skipped++;
+            continue;
+        }
+        delta = (now >= e->e_start[z]) ? now - e->e_start[z]
+                                       : now + src->range[z] - e->e_start[z];
+        e->joules += (double)delta * src->unit;
+    }
+    _timespec_accum(&e->window, e->t.end, e->w_start);
+    e->pending = 0;
+}
+
+
+/**
+ * Stop a lap of an energy stopwatch and accumulate its time.  Reads the
+ * energy counters if the lap closes a window.
+ *
+ * @sa ctimer_energy_start
+ */
+static inline
+void ctimer_energy_stop(
+    ctimer_energy_t * e         /**<[in,out] energy stopwatch */
+) {
+    ctimer_pause(&e->t);
+    if (++e->pending >= e->batch)
+        ctimer_energy_flush(e);
+}
+
+
+/**
+ * Return the average power (watts) over the closed energy windows of an
+ * energy stopwatch, or a negative value if no energy was measured.
+ */
+static inline
+double ctimer_energy_watts(
+    ctimer_energy_t const * e   /**<[in] energy stopwatch */
+) {
+    double const sec = timespec_sec(e->window);
+    if ((e->src->nzones == 0) || (sec <= 0))
+        return -1;
+    return e->joules / sec;
+}
+
+
+/**
+ * Print a line with the `elapsed` time of an energy stopwatch in seconds, the
+ * estimated energy of the timed laps in joules, and the average power in
+ * watts.  Closes any open energy window first.
+ *
+ * The line is printed as:
+ * ```
+ * Time(<label>) = XX.XXXXXXXXX sec, Energy = YY.YYYYYY J, Power = ZZ.ZZZ W
+ * Time(<label>) = XX.XXXXXXXXX sec, Energy unavailable
+ * ```
+ *
+ * If counter reads failed for some windows, the energy line ends with
+ * `[N zone windows skipped]`; the energy of those windows is not counted.
+ *
+ * @sa ctimer_print
+ */
+static inline
+void ctimer_energy_print(
+    ctimer_energy_t       * e,     /**<[in,out] energy stopwatch */
+    char            const * label  /**<[in]     label/description */
+) {
+    double watts;
+
+    ctimer_energy_flush(e);
+    watts = ctimer_energy_watts(e);
+    if ((label != NULL) && (label[0] != '\0'))
+        printf("Time(%s) = ", label);
+    else
+        printf("Time = ");
+    printf("%ld.%09ld sec, ", (long)e->t.elapsed.tv_sec, e->t.elapsed.tv_nsec);
+    if (watts < 0) {
+        printf("Energy unavailable\n");
+        return;
+    }
+    printf("Energy = %.6f J, Power = %.3f W",
+           watts * timespec_sec(e->t.elapsed), watts);
+    if (e->skipped > 0)
+        printf(" [%lu zone windows skipped]", e->skipped);
+    printf("\n");
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_energy */
+
+
+#endif  /* __H_CTIMER_ENERGY__ */
@@ -0,0 +1,314 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * CTimer decaying statistics: EWMA mean and variance, and time-decayed rate.
+ *
+ * @file        ctimer_ewma.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_EWMA__
+#define __H_CTIMER_EWMA__
+
+
+#include <stdio.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_ewma Decaying statistics API
+ * @ingroup ctimer
+ *
+ * Recent-history lap statistics, for consumers that act on current behavior
+ * (e.g., load balancing or admission control) rather than on totals.
+ *
+ * A `ctimer_ewma_t` accumulator tracks an exponentially weighted moving
+ * average (EWMA) of lap durations, their exponentially weighted variance, and
+ * a time-decayed rate of laps.  The mean and variance give each new lap a
+ * weight of `2^-shift` (e.g., `shift` 4 weighs in about the last 16 laps).
+ * The rate decays with the time between laps (not their number), with a
+ * given half-life; irregularly spaced laps are thus weighted by when they
+ * happened, and the rate decays towards 0 if laps stop.  Each update takes
+ * O(1) integer operations: the mean is kept in fixed point with
+ * `CTIMER_EWMA_FRAC` fractional bits, the variance in nsec^2, and the rate
+ * as a fixed-point decayed lap count (decay factors combine a table of
+ * fractional powers of 2 with a short series).
+ *
+ * Updates to an accumulator must come from one thread at a time (e.g., use
+ * one accumulator per thread, or update under a lock that readers need not
+ * take).  Readers on any thread call `ctimer_ewma_mean()`,
+ * `ctimer_ewma_var()`, `ctimer_ewma_stddev()`, or `ctimer_ewma_rate()`
+ * without locks: each field is written and read with relaxed atomic
+ * operations.
+ *
+ * @note Lap durations must be below 2^47 nsec (about 39 hours) and
+ * deviations from the mean are clamped to 2^32 nsec (about 4.3 sec) in the
+ * variance; the rate half-life must be below 2^47 nsec.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Fractional bits of the fixed-point mean and decayed count. */
+#define CTIMER_EWMA_FRAC 16
+
+
+/**
+ * Decaying lap statistics.
+ */
+typedef struct {
+    long          mean;         /**< Mean lap duration (nsec, fixed point) */
+    unsigned long var;          /**< Variance of lap durations (nsec^2) */
+    unsigned long decayed;      /**< Decayed lap count (fixed point) */
+    long          last;         /**< Time of last lap (nsec) */
+    unsigned long count;        /**< Number of laps */
+    int           shift;        /**< Lap weight is 2^-shift */
+    long          halflife;     /**< Rate half-life (nsec) */
+} ctimer_ewma_t;
+
+
+/**
+ * Initialize a decaying statistics accumulator with no laps.
+ */
+static inline
+void ctimer_ewma_init(
+    ctimer_ewma_t * e,          /**<[out] accumulator */
+    int const       shift,      /**<[in]  mean/variance weight: 2^-shift */
+    long const      halflife    /**<[in]  rate half-life (nsec) */
+) {
+    e->mean     = 0;
+    e->var      = 0;
+    e->decayed  = 0;
+    e->last     = 0;
+    e->count    = 0;
+    e->shift    = (shift < 0) ? 0
+        : ((shift > CTIMER_EWMA_FRAC) ? CTIMER_EWMA_FRAC : shift);
+    e->halflife = (halflife > 0) ? halflife : 1;
+}
+
+
+/* decay fixed-point count `c` over `dt` nsec: c * 2^(-dt/h) */
+static inline
+unsigned long _ctimer_ewma_decay(
+    unsigned long const c,
+    long          const dt,
+    long          const h
+) {
+    /* 2^(-i/16) in Q16, i = 0..15 */
+    static unsigned long const pow2[16] = {
+        65536, 62757, 60097, 57549, 55109, 52773, 50535, 48393,
+        46341, 44376, 42495, 40693, 38968, 37316, 35734, 34219
+    };
+    unsigned long y, z, z2, z3, m, r;
+    long          q, i;
+    if (dt <= 0)
+        return c;
+    q = dt / h;
+    if (q >= 64)
+        return 0;
+    /* 2^(-(dt % h)/h) = 2^(-i/16) * e^(-z), with z = y ln2 / 16 and y in
+     * [0, 1) (Q32), and e^(-z) ~ 1 - z + z^2/2 - z^3/6 (z < 0.044) */
+    r  = (unsigned long)(dt % h) * 16;
+    i  = r / h;
+    r -= i * h;
+    y  = (((r << 16) / h) << 16) + ((((r << 16) % h) << 16) / h);
+    z  = (y * 186065280UL) >> 32;                 /* ln2 in Q28 */
+    z2 = (z * z) >> 32;
+    z3 = (z2 * z) >> 32;
+    m  = (pow2[i] * ((1UL << 32) - z + (z2 >> 1) - z3 / 6)) >> 16;
+    /* (c >> q) * m in Q32, without overflow */
+    r  = c >> q;
+    return (r >> 32) * m + (((r & 0xffffffffUL) * m) >> 32);
+}
+
+
+/**
+ * Add one lap of duration `ns` nsec, completed at time `now` (nsec, e.g.,
+ * `timespec_nsec()` of a `CLOCK_MONOTONIC` reading), to the accumulator.
+ */
+static inline
+void ctimer_ewma_add(
+    ctimer_ewma_t * e,          /**<[in,out] accumulator */
+    long const      ns,         /**<[in]     lap duration (nsec) */
+    long const      now         /**<[in]     lap time (nsec) */
+) {
+    long const    x = ns * (1L << CTIMER_EWMA_FRAC);
+    long          mean, d;
+    unsigned long var, d2, a;
+
+    if (e->count == 0) {
+        mean = x;
+        var  = 0;
+    } else {
+        /* mean += 2^-k (x - mean); var = (1 - 2^-k) (var + 2^-k d^2) */
+        d    = (x - e->mean) / (1L << CTIMER_EWMA_FRAC);
+        mean = e->mean + ((x - e->mean) >> e->shift);
+        if (d < 0)
+            d = -d;
+        if (d > 0xffffffffL)
+            d = 0xffffffffL;
+        d2  = (unsigned long)d * (unsigned long)d;
+        a   = d2 >> e->shift;
+        var = e->var - (e->var >> e->shift) + a - (a >> e->shift);
+    }
+    __atomic_store_n(&e->mean, mean, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->var,  var,  __ATOMIC_RELAXED);
+    __atomic_store_n(&e->decayed,
+                     _ctimer_ewma_decay(e->decayed, now - e->last,
+                                        e->halflife)
+                     + (1UL << CTIMER_EWMA_FRAC), __ATOMIC_RELAXED);
+    __atomic_store_n(&e->last,  now,          __ATOMIC_RELAXED);
+    __atomic_store_n(&e->count, e->count + 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Add the `start`-to-`end` duration of a stopped `ctimer_t` stopwatch,
+ * completed at its `end` time, to the accumulator.
+ */
+static inline
+void ctimer_ewma_lap(
+    ctimer_ewma_t       * e,    /**<[in,out] accumulator */
+    ctimer_t      const * t     /**<[in]     stopped stopwatch */
+) {
+    long const end = timespec_nsec(t->end);
+    ctimer_ewma_add(e, end - timespec_nsec(t->start), end);
+}
+
+
+/**
+ * Return the EWMA of lap durations (nsec; 0 if there are no laps).
+ */
+static inline
+long ctimer_ewma_mean(
+    ctimer_ewma_t const * e     /**<[in] accumulator */
+) {
+    return __atomic_load_n(&e->mean, __ATOMIC_RELAXED)
+        / (1L << CTIMER_EWMA_FRAC);
+}
+
+
+/**
+ * Return the exponentially weighted variance of lap durations (nsec^2).
+ */
+static inline
+unsigned long ctimer_ewma_var(
+    ctimer_ewma_t const * e     /**<[in] accumulator */
+) {
+    return __atomic_load_n(&e->var, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Return the exponentially weighted standard deviation of lap durations
+ * (nsec, rounded down).
+ */
+static inline
+long ctimer_ewma_stddev(
+    ctimer_ewma_t const * e     /**<[in] accumulator */
+) {
+    unsigned long const v = ctimer_ewma_var(e);
+    unsigned long       r = 0, b = 1UL << 62;
+    unsigned long       x = v;
+    /* integer square root, by bits */
+    while (b > x)
+        b >>= 2;
+    for (; b != 0; b >>= 2) {
+        if (x >= r + b) {
+            x -= r + b;
+            r  = (r >> 1) + b;
+        } else
+            r >>= 1;
+    }
+    return (long)r;
+}
+
+
+/**
+ * Return the time-decayed lap rate (laps/sec) as of time `now` (nsec).
+ *
+ * For laps at a steady rate, this converges to that rate within a few
+ * half-lives; it decays by half every half-life without laps.
+ */
+static inline
+double ctimer_ewma_rate(
+    ctimer_ewma_t const * e,    /**<[in] accumulator */
+    long const            now   /**<[in] current time (nsec) */
+) {
+    unsigned long const c = __atomic_load_n(&e->decayed, __ATOMIC_RELAXED);
+    long const          t = __atomic_load_n(&e->last, __ATOMIC_RELAXED);
+    /* decayed count of laps at rate R converges to R * halflife / ln 2 */
+    return (double)_ctimer_ewma_decay(c, now - t, e->halflife)
+        / (1UL << CTIMER_EWMA_FRAC) * 0.69314718055994531 / e->halflife
+        * 1e9;
+}
+
+
+/**
+ * Print a line with the EWMA and standard deviation of lap durations, the
+ * current lap rate, and the lap count of an accumulator.
+ *
+ * The line is printed as:
+ * ```
+ * Ewma(<label>) = mean A nsec; stddev B nsec; rate R/s [N laps]
+ * ```
+ */
+static inline
+void ctimer_ewma_print(
+    ctimer_ewma_t const * e,    /**<[in] accumulator */
+    char const          * label /**<[in] label */
+) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("Ewma(%s) = mean %ld nsec; stddev %ld nsec; rate %.1f/s"
+           " [%lu laps]\n", label, ctimer_ewma_mean(e), ctimer_ewma_stddev(e),
+           ctimer_ewma_rate(e, timespec_nsec(now)),
+           __atomic_load_n(&e->count, __ATOMIC_RELAXED));
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_ewma */
+
+
+#endif  /* __H_CTIMER_EWMA__ */
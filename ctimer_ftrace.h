@@ -0,0 +1,296 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * ftrace trace_marker events for CTimer stopwatches.
+ *
+ * @file        ctimer_ftrace.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_FTRACE__
+#define __H_CTIMER_FTRACE__
+
+
+#include <time.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/**
+ * @defgroup ctimer_ftrace ftrace marker API
+ * @ingroup ctimer
+ *
+ * Stopwatch events on the kernel's ftrace timeline.
+ *
+ * When `CTIMER_FTRACE` is defined before `ctimer.h` is included, stopwatch
+ * starts (including resumes) and stops (including pauses) also write a marker
+ * to the ftrace `trace_marker` file, so that timed sections appear next to
+ * scheduler, block I/O, and other kernel events in `trace-cmd` or `perf`
+ * traces.  Markers are off by default: tracing starts only after
+ * `ctimer_ftrace_open()` and `ctimer_ftrace_enable()` (or
+ * `ctimer_ftrace_init_env()`), and costs one relaxed load per event while
+ * disabled.
+ *
+ * Each event is one `write()` of a short marker, formatted without stdio:
+ * ```
+ * ctimer <kind> <id> <nsec>
+ * ```
+ * where `kind` is `S` (start), `E` (stop), `M` (instant mark), or `N` (name
+ * of `id`, with the name in place of `nsec`); `id` is the stopwatch address
+ * in hex; and `nsec` is the stopwatch's `CLOCK_MONOTONIC` timestamp.  The
+ * marker file is opened once and kept open.  `ctimer_ftrace_merge.py` pairs
+ * start/stop markers of a trace into intervals.
+ *
+ * @note This header does not depend on `ctimer.h`, which includes it when
+ * `CTIMER_FTRACE` is defined; it may also be used on its own to emit explicit
+ * markers.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* marker file descriptor and switch; weak, so all translation units share
+ * one */
+__attribute__((weak)) int ctimer_ftrace_fd      = -1;
+__attribute__((weak)) int ctimer_ftrace_enabled = 0;
+
+
+/**
+ * Open the ftrace marker file and keep it open.  If `path` is `NULL`, tries
+ * `/sys/kernel/tracing/trace_marker` and then
+ * `/sys/kernel/debug/tracing/trace_marker`.  Does not enable markers.
+ *
+ * @return 0 on success, or -1 if the file cannot be opened (e.g., tracefs is
+ * not mounted or not writable)
+ *
+ * @sa ctimer_ftrace_enable
+ * @sa ctimer_ftrace_close
+ */
+static inline
+int ctimer_ftrace_open(
+    char const * path           /**<[in] marker file path, or NULL */
+) {
+    int fd;
+    if (ctimer_ftrace_fd >= 0)
+        return 0;
+    if (path != NULL)
+        fd = open(path, O_WRONLY | O_CLOEXEC);
+    else {
+        fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+            fd = open("/sys/kernel/debug/tracing/trace_marker",
+                      O_WRONLY | O_CLOEXEC);
+    }
+    if (fd < 0)
+        return -1;
+    ctimer_ftrace_fd = fd;
+    return 0;
+}
+
+
+/**
+ * Turn stopwatch markers on (`on` non-zero) or off at runtime.  Markers are
+ * only written while the marker file is open.
+ */
+static inline
+void ctimer_ftrace_enable(
+    int const on                /**<[in] enable flag */
+) {
+    __atomic_store_n(&ctimer_ftrace_enabled,
+                     (on && (ctimer_ftrace_fd >= 0)), __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Open the marker file and enable markers if the `CTIMER_FTRACE` environment
+ * variable is set to a value other than "0".
+ *
+ * @return 1 if markers were enabled, or 0 otherwise
+ */
+static inline
+int ctimer_ftrace_init_env(void) {
+    char const * v = getenv("CTIMER_FTRACE");
+    if ((v == NULL) || (v[0] == '\0') || ((v[0] == '0') && (v[1] == '\0')))
+        return 0;
+    if (ctimer_ftrace_open(NULL) != 0)
+        return 0;
+    ctimer_ftrace_enable(1);
+    return 1;
+}
+
+
+/**
+ * Disable markers and close the marker file.
+ */
+static inline
+void ctimer_ftrace_close(void) {
+    ctimer_ftrace_enable(0);
+    if (ctimer_ftrace_fd >= 0)
+        close(ctimer_ftrace_fd);
+    ctimer_ftrace_fd = -1;
+}
+
+
+/* append the hex digits of x to p; return the new end */
+static inline
+char * _ctimer_ftrace_hex(
+    char      * p,
+    uintptr_t   x
+) {
+    char tmp[2 * sizeof(uintptr_t)];
+    int  n = 0;
+    do {
+        tmp[n++] = "0123456789abcdef"[x & 0xf];
+        x >>= 4;
+    } while (x != 0);
+    while (n > 0)
+        *p++ = tmp[--n];
+    return p;
+}
+
+
+/* append the decimal digits of x to p; return the new end */
+static inline
+char * _ctimer_ftrace_dec(
+    char          * p,
+    unsigned long   x
+) {
+    char tmp[20];
+    int  n = 0;
+    do {
+        tmp[n++] = (char)('0' + (x % 10));
+        x /= 10;
+    } while (x != 0);
+    while (n > 0)
+        *p++ = tmp[--n];
+    return p;
+}
+
+
+/* format "ctimer <kind> <id> " into buf; return the end */
+static inline
+char * _ctimer_ftrace_head(
+    char             * buf,
+    char         const kind,
+    void const       * id
+) {
+    char * p = buf;
+    p[0] = 'c'; p[1] = 't'; p[2] = 'i'; p[3] = 'm'; p[4] = 'e'; p[5] = 'r';
+    p[6] = ' '; p[7] = kind; p[8] = ' ';
+    p = _ctimer_ftrace_hex(p + 9, (uintptr_t)id);
+    *p++ = ' ';
+    return p;
+}
+
+
+/**
+ * Write a `kind` marker for stopwatch `id` at timestamp `ts`, if markers are
+ * enabled.  Called by the `ctimer.h` stopwatch functions when `CTIMER_FTRACE`
+ * is defined.
+ */
+static inline
+void ctimer_ftrace_emit(
+    char            const   kind, /**<[in] marker kind ('S', 'E', 'M') */
+    void            const * id,   /**<[in] stopwatch address (or other id) */
+    struct timespec const   ts    /**<[in] event timestamp */
+) {
+    char     buf[64];
+    char   * p;
+    ssize_t  ret;
+    if (__builtin_expect(
+            !__atomic_load_n(&ctimer_ftrace_enabled, __ATOMIC_RELAXED), 1))
+        return;
+    p   = _ctimer_ftrace_head(buf, kind, id);
+    p   = _ctimer_ftrace_dec(p, (unsigned long)ts.tv_sec * 1000000000UL
+                                + (unsigned long)ts.tv_nsec);
+    ret = write(ctimer_ftrace_fd, buf, (size_t)(p - buf));
+    (void)ret;
+}
+
+
+/**
+ * Write an instant marker for `id` at the current `CLOCK_MONOTONIC` time, if
+ * markers are enabled.
+ */
+static inline
+void ctimer_ftrace_mark(
+    void const * id             /**<[in] marker id */
+) {
+    struct timespec now;
+    if (!__atomic_load_n(&ctimer_ftrace_enabled, __ATOMIC_RELAXED))
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ctimer_ftrace_emit('M', id, now);
+}
+
+
+/**
+ * Associate a name with `id` in the trace, if markers are enabled.  Names
+ * longer than 200 bytes are truncated.  `ctimer_ftrace_merge.py` labels the
+ * intervals of `id` with the last name written before them.
+ */
+static inline
+void ctimer_ftrace_name(
+    void const * id,            /**<[in] stopwatch address (or other id) */
+    char const * name           /**<[in] name */
+) {
+    char     buf[256];
+    char   * p;
+    int      i;
+    ssize_t  ret;
+    if (!__atomic_load_n(&ctimer_ftrace_enabled, __ATOMIC_RELAXED))
+        return;
+    p = _ctimer_ftrace_head(buf, 'N', id);
+    for (i = 0; (name[i] != '\0') && (i < 200); ++i)
+        *p++ = (name[i] == '\n') ? ' ' : name[i];
+    ret = write(ctimer_ftrace_fd, buf, (size_t)(p - buf));
+    (void)ret;
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_ftrace */
+
+
+#endif  /* __H_CTIMER_FTRACE__ */
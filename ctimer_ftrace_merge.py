@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+# -*- python -*-
+
+# Merge CTimer ftrace markers into intervals.
+#
+# Reads a text trace (the tracefs `trace` file, `trace-cmd report`, or
+# `perf script` output) with markers written by `ctimer_ftrace.h`, pairs each
+# stopwatch's start (S) and stop (E) markers per thread, and prints one
+# interval per line:
+#
+#   tid comm cpu id name start end trace_dur_us ctimer_dur_ns
+#
+# where `start` and `end` are trace timestamps (seconds, on the trace clock),
+# `trace_dur_us` is their difference, and `ctimer_dur_ns` is the duration
+# measured by the stopwatch itself (CLOCK_MONOTONIC).  With `--summary`, prints
+# per-name counts and total/mean/max durations instead.  With `--chrome`,
+# writes Chrome trace-event JSON (for chrome://tracing or Perfetto).
+#
+# Author:    Alexandros-Stavros Iliopoulos
+# License:   MIT
+# Copyright: Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+
+import argparse
+import json
+import re
+import sys
+
+# "<comm>-<pid> [cpu] ... <ts>: ...ctimer <kind> <id> <rest>"; perf script
+# separates comm and pid with spaces instead of '-'
+LINE = re.compile(
+    r'^\s*(?P<comm>.+?)[- ]\s*(?P<tid>\d+)\s+(?:\(\s*[-\d]+\)\s+)?'
+    r'\[(?P<cpu>\d+)\].*?\s(?P<ts>\d+\.\d+):'
+    r'.*?\bctimer (?P<kind>[SEMN]) (?P<id>[0-9a-f]+)(?: (?P<rest>.*?))?\s*$')
+
+
+def parse(lines):
+    """Yield (tid, comm, cpu, ts, kind, id, rest) for each CTimer marker."""
+    for line in lines:
+        m = LINE.match(line)
+        if m is None:
+            continue
+        yield (int(m.group('tid')), m.group('comm').strip(),
+               int(m.group('cpu')), float(m.group('ts')), m.group('kind'),
+               m.group('id'), m.group('rest') or '')
+
+
+def merge(events):
+    """Pair start/stop markers into intervals, and collect instant marks.
+
+    Markers are paired per (thread, stopwatch id); a stop without a matching
+    start, or a start without a stop by the end of the trace, is counted as
+    unmatched.
+    """
+    names = {}
+    open_ = {}
+    intervals = []
+    marks = []
+    unmatched = 0
+    for tid, comm, cpu, ts, kind, sid, rest in events:
+        key = (tid, sid)
+        if kind == 'N':
+            names[sid] = rest
+        elif kind == 'S':
+            open_.setdefault(key, []).append((ts, int(rest), cpu))
+        elif kind == 'E':
+            stack = open_.get(key)
+            if not stack:
+                unmatched += 1
+                continue
+            ts0, ns0, cpu0 = stack.pop()
+            intervals.append({'tid': tid, 'comm': comm, 'cpu': cpu0,
+                              'id': sid, 'name': names.get(sid, sid),
+                              'start': ts0, 'end': ts,
+                              'ctimer_ns': int(rest) - ns0})
+        elif kind == 'M':
+            marks.append({'tid': tid, 'comm': comm, 'cpu': cpu, 'id': sid,
+                          'name': names.get(sid, sid), 'ts': ts})
+    unmatched += sum(len(s) for s in open_.values())
+    intervals.sort(key=lambda iv: iv['start'])
+    return intervals, marks, unmatched
+
+
+def print_intervals(intervals, out):
+    out.write('# tid comm cpu id name start end trace_dur_us ctimer_dur_ns\n')
+    for iv in intervals:
+        out.write('%d %s %d %s %s %.6f %.6f %.3f %d\n' % (
+            iv['tid'], iv['comm'], iv['cpu'], iv['id'], iv['name'],
+            iv['start'], iv['end'], (iv['end'] - iv['start']) * 1e6,
+            iv['ctimer_ns']))
+
+
+def print_summary(intervals, out):
+    stats = {}
+    for iv in intervals:
+        s = stats.setdefault(iv['name'], [0, 0, 0])
+        s[0] += 1
+        s[1] += iv['ctimer_ns']
+        s[2] = max(s[2], iv['ctimer_ns'])
+    out.write('# name count total_ns mean_ns max_ns\n')
+    for name, (n, tot, mx) in sorted(stats.items(), key=lambda kv: -kv[1][1]):
+        out.write('%s %d %d %.1f %d\n' % (name, n, tot, tot / n, mx))
+
+
+def print_chrome(intervals, marks, out):
+    ev = []
+    for iv in intervals:
+        ev.append({'name': iv['name'], 'cat': 'ctimer', 'ph': 'X',
+                   'ts': iv['start'] * 1e6,
+                   'dur': (iv['end'] - iv['start']) * 1e6,
+                   'pid': 0, 'tid': iv['tid'],
+                   'args': {'cpu': iv['cpu'], 'ctimer_ns': iv['ctimer_ns']}})
+    for mk in marks:
+        ev.append({'name': mk['name'], 'cat': 'ctimer', 'ph': 'i', 's': 't',
+                   'ts': mk['ts'] * 1e6, 'pid': 0, 'tid': mk['tid']})
+    json.dump({'traceEvents': ev, 'displayTimeUnit': 'ns'}, out)
+    out.write('\n')
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description='Merge CTimer ftrace markers into intervals.')
+    ap.add_argument('trace', nargs='?', default='-',
+                    help='text trace file (default: stdin)')
+    g = ap.add_mutually_exclusive_group()
+    g.add_argument('--summary', action='store_true',
+                   help='print per-name totals instead of intervals')
+    g.add_argument('--chrome', action='store_true',
+                   help='write Chrome trace-event JSON')
+    args = ap.parse_args()
+
+    f = sys.stdin if args.trace == '-' else open(args.trace)
+    intervals, marks, unmatched = merge(parse(f))
+    if args.summary:
+        print_summary(intervals, sys.stdout)
+    elif args.chrome:
+        print_chrome(intervals, marks, sys.stdout)
+    else:
+        print_intervals(intervals, sys.stdout)
+    if unmatched:
+        sys.stderr.write('ctimer_ftrace_merge: %d unmatched markers\n'
+                         % unmatched)
+
+
+if __name__ == '__main__':
+    main()
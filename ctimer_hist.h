@@ -0,0 +1,634 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Log-linear latency histograms for CTimer stopwatches.
+ *
+ * @file        ctimer_hist.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_HIST__
+#define __H_CTIMER_HIST__
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ctimer.h"
+#include "ctimer_buf.h"
+
+
+/**
+ * @defgroup ctimer_hist Histogram API
+ * @ingroup ctimer
+ *
+ * Fixed-layout log-linear histograms of lap durations in nsec.
+ *
+ * Values below 2^`CTIMER_HIST_SUB_BITS` nsec get one bucket each; above that,
+ * every power-of-2 range is split into 2^`CTIMER_HIST_SUB_BITS` equal-width
+ * buckets, so the relative bucket width (and thus percentile error) is at most
+ * 2^-`CTIMER_HIST_SUB_BITS` (about 3% by default).  Values of
+ * 2^`CTIMER_HIST_MAX_BITS` nsec or more (about 73 minutes by default) are
+ * counted in the last bucket and in `overflow`.
+ *
+ * Bucket counts live in a `ctimer_buf_t` buffer (huge pages where possible,
+ * prefaulted).  `ctimer_hist_record()` is for single-writer histograms, and
+ * `ctimer_hist_record_atomic()` for histograms shared between threads.
+ *
+ * After `ctimer_hist_exemplars()`, a histogram also keeps one exemplar per
+ * bucket: the 64-bit tag (e.g., a request or trace id), timestamp, and value
+ * of the most recent sample recorded with `ctimer_hist_record_tagged()` (or
+ * its atomic and stopwatch variants).  Exemplars link a slow bucket to an
+ * individual request without storing all samples; they are listed with the
+ * buckets by `ctimer_hist_print_buckets()` and looked up by quantile with
+ * `ctimer_hist_exemplar()`.  Each exemplar is guarded by its own sequence
+ * counter: writers use plain stores (no locks or read-modify-write
+ * operations, except that concurrent writers of the atomic variant skip a
+ * bucket whose exemplar is being written), and readers retry torn reads.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Sub-bucket bits (precision).  May be overridden. */
+#ifndef CTIMER_HIST_SUB_BITS
+#define CTIMER_HIST_SUB_BITS 5
+#endif
+
+/** Value range bits: values up to 2^`CTIMER_HIST_MAX_BITS` nsec. */
+#ifndef CTIMER_HIST_MAX_BITS
+#define CTIMER_HIST_MAX_BITS 42
+#endif
+
+/** Number of histogram buckets. */
+#define CTIMER_HIST_NBUCKETS \
+    ((CTIMER_HIST_MAX_BITS - CTIMER_HIST_SUB_BITS + 1) << CTIMER_HIST_SUB_BITS)
+
+
+/**
+ * Histogram bucket exemplar.
+ */
+typedef struct {
+    unsigned long seq;          /**< Sequence counter (odd while written) */
+    unsigned long tag;          /**< Sample tag (e.g., request id) */
+    long          ts;           /**< Sample timestamp (nsec); 0 if none */
+    long          value;        /**< Sample value (nsec) */
+} ctimer_exemplar_t;
+
+
+/**
+ * Latency histogram struct.
+ */
+typedef struct {
+    unsigned long     * counts;    /**< Per-bucket sample counts */
+    unsigned long       count;     /**< Number of samples */
+    long                sum;       /**< Sum of samples (nsec) */
+    long                max;       /**< Largest sample (nsec) */
+    unsigned long       overflow;  /**< Samples beyond the value range */
+    ctimer_buf_t        buf;       /**< Backing buffer */
+    ctimer_exemplar_t * exemplars; /**< Per-bucket exemplars, or NULL */
+    ctimer_buf_t        ebuf;      /**< Backing buffer of exemplars */
+} ctimer_hist_t;
+
+
+/**
+ * Allocate an empty histogram.  `flags` are passed to `ctimer_buf_alloc()`.
+ *
+ * @return 0 on success, or -1 on allocation failure
+ *
+ * @sa ctimer_hist_destroy
+ */
+static inline
+int ctimer_hist_init(
+    ctimer_hist_t * h,          /**<[out] histogram */
+    int const       flags       /**<[in]  `CTIMER_BUF_*` flags */
+) {
+    h->count = 0;
+    h->sum   = 0;
+    h->max   = 0;
+    h->overflow = 0;
+    h->exemplars = NULL;
+    if (ctimer_buf_alloc(&h->buf, CTIMER_HIST_NBUCKETS * sizeof(unsigned long),
+                         flags) != 0)
+        return -1;
+    h->counts = (unsigned long *)h->buf.ptr;
+    return 0;
+}
+
+
+/**
+ * Release the buffer of a histogram.
+ */
+static inline
+void ctimer_hist_destroy(
+    ctimer_hist_t * h           /**<[in,out] histogram */
+) {
+    ctimer_buf_free(&h->buf);
+    h->counts = NULL;
+    if (h->exemplars != NULL)
+        ctimer_buf_free(&h->ebuf);
+    h->exemplars = NULL;
+}
+
+
+/**
+ * Enable per-bucket exemplars in a histogram.  `flags` are passed to
+ * `ctimer_buf_alloc()`.  Has no effect if exemplars are already enabled.
+ *
+ * @return 0 on success, or -1 on allocation failure
+ *
+ * @sa ctimer_hist_record_tagged
+ */
+static inline
+int ctimer_hist_exemplars(
+    ctimer_hist_t * h,          /**<[in,out] histogram */
+    int const       flags       /**<[in]     `CTIMER_BUF_*` flags */
+) {
+    if (h->exemplars != NULL)
+        return 0;
+    if (ctimer_buf_alloc(&h->ebuf,
+                         CTIMER_HIST_NBUCKETS * sizeof(ctimer_exemplar_t),
+                         flags) != 0)
+        return -1;
+    memset(h->ebuf.ptr, 0, CTIMER_HIST_NBUCKETS * sizeof(ctimer_exemplar_t));
+    h->exemplars = (ctimer_exemplar_t *)h->ebuf.ptr;
+    return 0;
+}
+
+
+/**
+ * Reset a histogram to zero samples.
+ */
+static inline
+void ctimer_hist_reset(
+    ctimer_hist_t * h           /**<[in,out] histogram */
+) {
+    int i;
+    for (i = 0; i < CTIMER_HIST_NBUCKETS; ++i)
+        h->counts[i] = 0;
+    h->count = 0;
+    h->sum   = 0;
+    h->max   = 0;
+    h->overflow = 0;
+    if (h->exemplars != NULL)
+        memset(h->exemplars, 0,
+               CTIMER_HIST_NBUCKETS * sizeof(ctimer_exemplar_t));
+}
+
+
+/**
+ * Return the bucket index of value `v` (nsec).
+ */
+static inline
+int ctimer_hist_bucket(
+    long const v                /**<[in] value (nsec) */
+) {
+    unsigned long const sub = 1UL << CTIMER_HIST_SUB_BITS;
+    unsigned long const u   = (v > 0) ? (unsigned long)v : 0;
+    int                 msb, shift;
+
+    if (u < sub)
+        return (int)u;
+    msb = 63 - __builtin_clzl(u);
+    if (msb >= CTIMER_HIST_MAX_BITS)
+        return CTIMER_HIST_NBUCKETS - 1;
+    shift = msb - CTIMER_HIST_SUB_BITS;
+    return (int)(((unsigned long)(shift + 1) << CTIMER_HIST_SUB_BITS)
+                 + ((u >> shift) - sub));
+}
+
+
+/**
+ * Return the lowest value (nsec) of bucket `i`.
+ */
+static inline
+long ctimer_hist_bucket_low(
+    int const i                 /**<[in] bucket index */
+) {
+    int const sub = 1 << CTIMER_HIST_SUB_BITS;
+    int       shift;
+    if (i < sub)
+        return i;
+    shift = i / sub - 1;
+    return (long)(i % sub + sub) << shift;
+}
+
+
+/**
+ * Return one past the highest value (nsec) of bucket `i`.
+ */
+static inline
+long ctimer_hist_bucket_high(
+    int const i                 /**<[in] bucket index */
+) {
+    int const sub = 1 << CTIMER_HIST_SUB_BITS;
+    if (i < sub)
+        return i + 1;
+    return ctimer_hist_bucket_low(i) + (1L << (i / sub - 1));
+}
+
+
+/**
+ * Record one sample of `v` nsec in a single-writer histogram.
+ */
+static inline
+void ctimer_hist_record(
+    ctimer_hist_t * h,          /**<[in,out] histogram */
+    long const      v           /**<[in]     sample (nsec) */
+) {
+    int const i = ctimer_hist_bucket(v);
+    h->counts[i]++;
+    h->count++;
+    h->sum += v;
+    if (v > h->max)
+        h->max = v;
+    if ((i == CTIMER_HIST_NBUCKETS - 1) && (v >= ctimer_hist_bucket_high(i)))
+        h->overflow++;
+}
+
+
+/**
+ * Record one sample of `v` nsec in a histogram shared between threads, using
+ * relaxed atomic operations.
+ */
+static inline
+void ctimer_hist_record_atomic(
+    ctimer_hist_t * h,          /**<[in,out] histogram */
+    long const      v           /**<[in]     sample (nsec) */
+) {
+    int const i   = ctimer_hist_bucket(v);
+    long      max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->counts[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, v, __ATOMIC_RELAXED);
+    while ((v > max)
+           && !__atomic_compare_exchange_n(&h->max, &max, v, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    if ((i == CTIMER_HIST_NBUCKETS - 1) && (v >= ctimer_hist_bucket_high(i)))
+        __atomic_fetch_add(&h->overflow, 1, __ATOMIC_RELAXED);
+}
+
+
+/* write exemplar `e` after its sequence counter was made odd */
+static inline
+void _ctimer_exemplar_write(
+    ctimer_exemplar_t   * e,
+    unsigned long const   seq,
+    unsigned long const   tag,
+    long          const   ts,
+    long          const   v
+) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e->tag,   tag, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->ts,    ts,  __ATOMIC_RELAXED);
+    __atomic_store_n(&e->value, v,   __ATOMIC_RELAXED);
+    __atomic_store_n(&e->seq,   seq + 2, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Record one sample of `v` nsec in a single-writer histogram and, if
+ * exemplars are enabled, make (`tag`, `ts`, `v`) the exemplar of its bucket.
+ *
+ * @sa ctimer_hist_exemplars
+ */
+static inline
+void ctimer_hist_record_tagged(
+    ctimer_hist_t       * h,    /**<[in,out] histogram */
+    long          const   v,    /**<[in]     sample (nsec) */
+    unsigned long const   tag,  /**<[in]     sample tag */
+    long          const   ts    /**<[in]     sample timestamp (nsec) */
+) {
+    ctimer_hist_record(h, v);
+    if (h->exemplars != NULL) {
+        ctimer_exemplar_t * e   = &h->exemplars[ctimer_hist_bucket(v)];
+        unsigned long const seq = e->seq;
+        __atomic_store_n(&e->seq, seq + 1, __ATOMIC_RELAXED);
+        _ctimer_exemplar_write(e, seq, tag, ts, v);
+    }
+}
+
+
+/**
+ * Record one sample of `v` nsec in a histogram shared between threads and,
+ * if exemplars are enabled, make (`tag`, `ts`, `v`) the exemplar of its
+ * bucket unless another thread is writing that exemplar.
+ */
+static inline
+void ctimer_hist_record_tagged_atomic(
+    ctimer_hist_t       * h,    /**<[in,out] histogram */
+    long          const   v,    /**<[in]     sample (nsec) */
+    unsigned long const   tag,  /**<[in]     sample tag */
+    long          const   ts    /**<[in]     sample timestamp (nsec) */
+) {
+    ctimer_hist_record_atomic(h, v);
+    if (h->exemplars != NULL) {
+        ctimer_exemplar_t * e   = &h->exemplars[ctimer_hist_bucket(v)];
+        unsigned long       seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+        if (((seq & 1) == 0)
+            && __atomic_compare_exchange_n(&e->seq, &seq, seq + 1, 0,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            _ctimer_exemplar_write(e, seq, tag, ts, v);
+    }
+}
+
+
+/**
+ * Return a consistent copy of the exemplar of bucket `i` (`ts` is 0 if the
+ * bucket has none).
+ */
+static inline
+ctimer_exemplar_t ctimer_hist_exemplar_load(
+    ctimer_hist_t const * h,    /**<[in] histogram with exemplars */
+    int           const   i     /**<[in] bucket index */
+) {
+    ctimer_exemplar_t const * e = &h->exemplars[i];
+    ctimer_exemplar_t         x;
+    unsigned long             seq;
+    do {
+        while ((seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        x.tag   = __atomic_load_n(&e->tag,   __ATOMIC_RELAXED);
+        x.ts    = __atomic_load_n(&e->ts,    __ATOMIC_RELAXED);
+        x.value = __atomic_load_n(&e->value, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq);
+    x.seq = seq;
+    return x;
+}
+
+
+/**
+ * Record one sample of `v` nsec in a single-writer histogram, plus the samples
+ * that a stall of `v` nsec kept from being recorded when samples are expected
+ * every `interval` nsec: `v - interval`, `v - 2*interval`, ..., down to
+ * `interval` (as HdrHistogram's `recordValueWithExpectedInterval`).
+ * Back-filled values are counted per bucket, so the cost grows with the number
+ * of buckets spanned rather than with `v / interval`.
+ *
+ * @return number of back-filled samples
+ */
+static inline
+unsigned long ctimer_hist_record_expected(
+    ctimer_hist_t * h,          /**<[in,out] histogram */
+    long const      v,          /**<[in]     sample (nsec) */
+    long const      interval    /**<[in]     expected interval (nsec); <= 0
+                                             disables back-filling */
+) {
+    unsigned long n, total;
+    long          x;
+
+    ctimer_hist_record(h, v);
+    if ((interval <= 0) || (v < 2 * interval))
+        return 0;
+
+    /* back-fill x, x - interval, ..., interval, one bucket at a time */
+    x     = v - interval;
+    total = n = (unsigned long)(x / interval);
+    while (n > 0) {
+        int const     i   = ctimer_hist_bucket(x);
+        long const    top = ctimer_hist_bucket_high(CTIMER_HIST_NBUCKETS - 1);
+        long const    low = ((i == CTIMER_HIST_NBUCKETS - 1) && (x >= top))
+                            ? top : ctimer_hist_bucket_low(i);
+        unsigned long k   = (unsigned long)((x - low) / interval) + 1;
+        if (k > n)
+            k = n;
+        h->counts[i] += k;
+        h->count     += k;
+        h->sum       += (long)k * x - interval * (long)(k * (k - 1) / 2);
+        if (low == top)
+            h->overflow += k;
+        x -= (long)k * interval;
+        n -= k;
+    }
+    return total;
+}
+
+
+/**
+ * Record the `start`-to-`end` duration of a stopped `ctimer_t` stopwatch in a
+ * single-writer histogram.
+ */
+static inline
+void ctimer_hist_lap(
+    ctimer_hist_t       * h,    /**<[in,out] histogram */
+    ctimer_t      const * t     /**<[in]     stopped stopwatch */
+) {
+    ctimer_hist_record(h, timespec_nsec(t->end) - timespec_nsec(t->start));
+}
+
+
+/**
+ * Record the `start`-to-`end` duration of a stopped `ctimer_t` stopwatch in a
+ * single-writer histogram, with `tag` and the stopwatch `end` time as the
+ * bucket exemplar.
+ */
+static inline
+void ctimer_hist_lap_tagged(
+    ctimer_hist_t       * h,    /**<[in,out] histogram */
+    ctimer_t      const * t,    /**<[in]     stopped stopwatch */
+    unsigned long const   tag   /**<[in]     sample tag */
+) {
+    ctimer_hist_record_tagged(h, timespec_nsec(t->end)
+                              - timespec_nsec(t->start), tag,
+                              timespec_nsec(t->end));
+}
+
+
+/**
+ * Add the samples of histogram `src` to histogram `dst`.  If both keep
+ * exemplars, each bucket of `dst` keeps the more recent exemplar.
+ */
+static inline
+void ctimer_hist_merge(
+    ctimer_hist_t       * dst,  /**<[in,out] histogram */
+    ctimer_hist_t const * src   /**<[in]     histogram */
+) {
+    int i;
+    for (i = 0; i < CTIMER_HIST_NBUCKETS; ++i)
+        dst->counts[i] += src->counts[i];
+    dst->count += src->count;
+    dst->sum   += src->sum;
+    dst->overflow += src->overflow;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    if ((dst->exemplars != NULL) && (src->exemplars != NULL))
+        for (i = 0; i < CTIMER_HIST_NBUCKETS; ++i) {
+            ctimer_exemplar_t const x = ctimer_hist_exemplar_load(src, i);
+            if (x.ts > dst->exemplars[i].ts) {
+                unsigned long const seq = dst->exemplars[i].seq;
+                __atomic_store_n(&dst->exemplars[i].seq, seq + 1,
+                                 __ATOMIC_RELAXED);
+                _ctimer_exemplar_write(&dst->exemplars[i], seq, x.tag, x.ts,
+                                       x.value);
+            }
+        }
+}
+
+
+/**
+ * Return the value (nsec) at quantile `q` (in [0, 1]) of a histogram: the
+ * highest value of the bucket holding the sample of rank `ceil(q * count)`,
+ * capped at the largest sample.  Returns 0 for an empty histogram.
+ */
+static inline
+long ctimer_hist_percentile(
+    ctimer_hist_t const * h,    /**<[in] histogram */
+    double        const   q     /**<[in] quantile in [0, 1] */
+) {
+    unsigned long rank;
+    unsigned long seen = 0;
+    int           i;
+
+    if (h->count == 0)
+        return 0;
+    rank = (unsigned long)(q * (double)h->count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; i < CTIMER_HIST_NBUCKETS; ++i) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            long const v = ctimer_hist_bucket_high(i) - 1;
+            return (v < h->max) ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+
+/**
+ * Find an exemplar for quantile `q` (in [0, 1]) of a histogram with
+ * exemplars: that of the bucket holding the sample of rank `ceil(q * count)`
+ * or, if it has none, of the nearest higher bucket that has one.
+ *
+ * @return 1 if an exemplar was found and stored in `x`, or 0 otherwise
+ */
+static inline
+int ctimer_hist_exemplar(
+    ctimer_hist_t     const * h,  /**<[in]  histogram */
+    double            const   q,  /**<[in]  quantile in [0, 1] */
+    ctimer_exemplar_t       * x   /**<[out] exemplar */
+) {
+    unsigned long const count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    unsigned long       rank;
+    unsigned long       seen = 0;
+    int                 i;
+
+    if ((h->exemplars == NULL) || (count == 0))
+        return 0;
+    rank = (unsigned long)(q * (double)count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; (i < CTIMER_HIST_NBUCKETS) && (seen < rank); ++i)
+        seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+    for (i = (i > 0) ? i - 1 : 0; i < CTIMER_HIST_NBUCKETS; ++i) {
+        *x = ctimer_hist_exemplar_load(h, i);
+        if (x->ts != 0)
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Print a line with the sample count and selected percentiles of a histogram.
+ *
+ * The line is printed as:
+ * ```
+ * Hist(<label>) = N samples; p50/p90/p99/p99.9/max = A/B/C/D/E nsec
+ * ```
+ *
+ * @sa ctimer_hist_print_buckets
+ */
+static inline
+void ctimer_hist_print(
+    ctimer_hist_t const * h,     /**<[in] histogram */
+    char          const * label  /**<[in] label/description */
+) {
+    if ((label != NULL) && (label[0] != '\0'))
+        printf("Hist(%s) = ", label);
+    else
+        printf("Hist = ");
+    printf("%lu samples; p50/p90/p99/p99.9/max = %ld/%ld/%ld/%ld/%ld nsec\n",
+           h->count,
+           ctimer_hist_percentile(h, 0.50), ctimer_hist_percentile(h, 0.90),
+           ctimer_hist_percentile(h, 0.99), ctimer_hist_percentile(h, 0.999),
+           h->max);
+}
+
+
+/**
+ * Print one line per non-empty bucket of a histogram, with the bucket
+ * exemplar if the histogram keeps exemplars and the bucket has one.
+ *
+ * Lines are printed as:
+ * ```
+ * [LOW, HIGH) nsec: COUNT
+ * [LOW, HIGH) nsec: COUNT; exemplar 0xTAG = V nsec @ TS nsec
+ * ```
+ */
+static inline
+void ctimer_hist_print_buckets(
+    ctimer_hist_t const * h     /**<[in] histogram */
+) {
+    int i;
+    for (i = 0; i < CTIMER_HIST_NBUCKETS; ++i) {
+        ctimer_exemplar_t x;
+        if (h->counts[i] == 0)
+            continue;
+        printf("[%ld, %ld) nsec: %lu", ctimer_hist_bucket_low(i),
+               ctimer_hist_bucket_high(i), h->counts[i]);
+        if ((h->exemplars != NULL)
+            && ((x = ctimer_hist_exemplar_load(h, i)).ts != 0))
+            printf("; exemplar 0x%lx = %ld nsec @ %ld nsec", x.tag, x.value,
+                   x.ts);
+        printf("\n");
+    }
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_hist */
+
+
+#endif  /* __H_CTIMER_HIST__ */
@@ -0,0 +1,484 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Interval-set algebra (union, overlap, exclusive time) over CTimer time
+ * ranges.
+ *
+ * @file        ctimer_interval.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_INTERVAL__
+#define __H_CTIMER_INTERVAL__
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_interval Interval-set API
+ * @ingroup ctimer
+ *
+ * Sweep-line analysis of labeled time intervals.
+ *
+ * Intervals are half-open `[start, end)` ranges in nsec, tagged with a small
+ * integer label (e.g., "compute" or "communication").  A `ctimer_iset_t`
+ * sweep consumes intervals in non-decreasing order of `start` and accumulates,
+ * in a single pass:
+ *
+ * - the length of the union of each label's intervals (true wall time covered
+ *   by the label, regardless of how many threads were in it at once);
+ * - the pairwise overlap between the unions of any two labels;
+ * - the time covered by exactly one label ("exclusively X" time); and
+ * - the time covered by any label.
+ *
+ * The sweep keeps O(#labels) state and never stores the intervals themselves.
+ * Per-thread buffers (each sorted by `start`) can be streamed through
+ * `ctimer_iset_merge()`, which performs a k-way merge with a binary heap of
+ * stream heads, for O(n log k) total work over n intervals in k streams.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* ==================================================
+ * CONSTANTS AND TYPES
+ * ================================================== */
+
+
+/**
+ * Maximum number of distinct interval labels.  Labels must lie in
+ * `[0, CTIMER_ISET_MAX_LABELS)`.  May be overridden (up to 64) before including
+ * `ctimer_interval.h`.
+ */
+#ifndef CTIMER_ISET_MAX_LABELS
+#define CTIMER_ISET_MAX_LABELS 16
+#endif
+
+
+/**
+ * Labeled half-open time interval `[start, end)`, in nsec.
+ */
+typedef struct {
+    long     start;             /**< Interval start time (nsec) */
+    long     end;               /**< Interval end time (nsec) */
+    unsigned label;             /**< Interval label */
+} ctimer_interval_t;
+
+
+/**
+ * Interval stream callback.  Writes the next interval of the stream to `iv`
+ * and returns 1, or returns 0 when the stream is exhausted.
+ */
+typedef int (*ctimer_interval_next_fn)(
+    void              * ctx,    /**<[in,out] stream state */
+    ctimer_interval_t * iv      /**<[out]    next interval */
+);
+
+
+/**
+ * Interval stream: a callback and its state.  Intervals must be produced in
+ * non-decreasing order of `start`.
+ */
+typedef struct {
+    ctimer_interval_next_fn   next; /**< Stream callback */
+    void                    * ctx;  /**< Stream state */
+} ctimer_interval_src_t;
+
+
+/**
+ * Stream state for an in-memory buffer of intervals sorted by `start`.
+ *
+ * @sa ctimer_interval_array_next
+ */
+typedef struct {
+    ctimer_interval_t const * data; /**< Interval buffer */
+    size_t                    n;    /**< Number of intervals in buffer */
+    size_t                    i;    /**< Read position */
+} ctimer_interval_array_t;
+
+
+/**
+ * Interval-set sweep state and accumulated results.
+ *
+ * All lengths are in nsec.
+ */
+typedef struct {
+    long     union_len[CTIMER_ISET_MAX_LABELS]; /**< Union length per label */
+    long     exclusive[CTIMER_ISET_MAX_LABELS]; /**< Time covered only by label */
+    long     overlap[CTIMER_ISET_MAX_LABELS][CTIMER_ISET_MAX_LABELS];
+                                /**< Pairwise union overlap (`[i][j]`, i<j) */
+    long     covered;           /**< Time covered by any label */
+    long     first;             /**< Earliest interval start */
+    long     last;              /**< Latest interval end */
+    unsigned long count;        /**< Number of intervals consumed */
+
+    /* sweep state */
+    long     _pos;                              /* sweep position */
+    long     _hi[CTIMER_ISET_MAX_LABELS];       /* per-label coverage frontier */
+    unsigned long long _active;                 /* labels with _hi > _pos */
+} ctimer_iset_t;
+
+
+/* ==================================================
+ * INTERVAL STREAMS
+ * ================================================== */
+
+
+/**
+ * Return the `[start, end)` interval of a started and stopped `ctimer_t`
+ * stopwatch, tagged with `label`.
+ */
+static inline
+ctimer_interval_t ctimer_interval(
+    ctimer_t const t,           /**<[in] stopwatch */
+    unsigned const label        /**<[in] interval label */
+) {
+    ctimer_interval_t iv;
+    iv.start = timespec_nsec(t.start);
+    iv.end   = timespec_nsec(t.end);
+    iv.label = label;
+    return iv;
+}
+
+
+/**
+ * `ctimer_interval_next_fn` callback for `ctimer_interval_array_t` streams.
+ */
+static inline
+int ctimer_interval_array_next(
+    void              * ctx,    /**<[in,out] `ctimer_interval_array_t` pointer */
+    ctimer_interval_t * iv      /**<[out]    next interval */
+) {
+    ctimer_interval_array_t * a = (ctimer_interval_array_t *)ctx;
+    if (a->i >= a->n)
+        return 0;
+    *iv = a->data[a->i++];
+    return 1;
+}
+
+
+/**
+ * Initialize an array stream over `n` intervals sorted by `start`, and return
+ * the corresponding `ctimer_interval_src_t`.
+ */
+static inline
+ctimer_interval_src_t ctimer_interval_array_src(
+    ctimer_interval_array_t       * a,    /**<[out] array stream state */
+    ctimer_interval_t       const * data, /**<[in]  interval buffer */
+    size_t                  const   n     /**<[in]  number of intervals */
+) {
+    ctimer_interval_src_t src;
+    a->data = data;
+    a->n    = n;
+    a->i    = 0;
+    src.next = ctimer_interval_array_next;
+    src.ctx  = a;
+    return src;
+}
+
+
+/* ==================================================
+ * SWEEP
+ * ================================================== */
+
+
+/**
+ * Initialize (or reset) an interval-set sweep.
+ */
+static inline
+void ctimer_iset_init(
+    ctimer_iset_t * s           /**<[out] sweep state */
+) {
+    int i;
+    memset(s, 0, sizeof(*s));
+    s->first = LONG_MAX;
+    s->last  = LONG_MIN;
+    s->_pos  = LONG_MIN;
+    for (i = 0; i < CTIMER_ISET_MAX_LABELS; ++i)
+        s->_hi[i] = LONG_MIN;
+}
+
+
+/* Accumulate `d` nsec covered by exactly the labels in `mask`. */
+static inline
+void _ctimer_iset_account(
+    ctimer_iset_t            * s,
+    unsigned long long const   mask,
+    long               const   d
+) {
+    unsigned long long m;
+    int                single = ((mask & (mask - 1)) == 0);
+
+    s->covered += d;
+    for (m = mask; m != 0; m &= m - 1) {
+        int                i  = __builtin_ctzll(m);
+        unsigned long long mj;
+        s->union_len[i] += d;
+        if (single)
+            s->exclusive[i] += d;
+        for (mj = m & (m - 1); mj != 0; mj &= mj - 1)
+            s->overlap[i][__builtin_ctzll(mj)] += d;
+    }
+}
+
+
+/*
+ * Advance the sweep position to `to`, accounting for label coverage that ends
+ * along the way.  Because intervals arrive sorted by start, the coverage of
+ * label L beyond the sweep position is exactly [_pos, _hi[L]).
+ */
+static inline
+void _ctimer_iset_advance(
+    ctimer_iset_t * s,
+    long const      to
+) {
+    while ((s->_active != 0) && (s->_pos < to)) {
+        unsigned long long m;
+        long               next = to;
+
+        /* nearest frontier among active labels */
+        for (m = s->_active; m != 0; m &= m - 1) {
+            int i = __builtin_ctzll(m);
+            if (s->_hi[i] < next)
+                next = s->_hi[i];
+        }
+        _ctimer_iset_account(s, s->_active, next - s->_pos);
+        s->_pos = next;
+
+        for (m = s->_active; m != 0; m &= m - 1) {
+            int i = __builtin_ctzll(m);
+            if (s->_hi[i] <= next)
+                s->_active &= ~(1ULL << i);
+        }
+    }
+    if (s->_pos < to)
+        s->_pos = to;
+}
+
+
+/**
+ * Push one interval into the sweep.
+ *
+ * @warning Intervals must be pushed in non-decreasing order of `start`.
+ *
+ * @return 0 on success, or -1 if the interval is out of order or its label is
+ * out of range (the interval is ignored).
+ */
+static inline
+int ctimer_iset_push(
+    ctimer_iset_t           * s, /**<[in,out] sweep state */
+    ctimer_interval_t const   iv /**<[in]     next interval */
+) {
+    if ((iv.label >= CTIMER_ISET_MAX_LABELS) || (iv.start < s->_pos))
+        return -1;
+    s->count++;
+    if (iv.start < s->first)
+        s->first = iv.start;
+    if (iv.end > s->last)
+        s->last = iv.end;
+    if (iv.end <= iv.start)
+        return 0;
+
+    _ctimer_iset_advance(s, iv.start);
+    if (iv.end > s->_hi[iv.label])
+        s->_hi[iv.label] = iv.end;
+    s->_active |= 1ULL << iv.label;
+    return 0;
+}
+
+
+/**
+ * Finish the sweep, accounting for all coverage that extends past the last
+ * pushed interval start.  Must be called before querying results.
+ */
+static inline
+void ctimer_iset_finish(
+    ctimer_iset_t * s           /**<[in,out] sweep state */
+) {
+    _ctimer_iset_advance(s, LONG_MAX);
+}
+
+
+/* sift-down for the k-way merge heap (min-heap on head start time) */
+static inline
+void _ctimer_iset_heap_down(
+    ctimer_interval_t * head,
+    int               * heap,
+    int const           n,
+    int                 i
+) {
+    for (;;) {
+        int l = 2 * i + 1;
+        int m = i;
+        int tmp;
+        if ((l < n) && (head[heap[l]].start < head[heap[m]].start))
+            m = l;
+        if ((l + 1 < n) && (head[heap[l + 1]].start < head[heap[m]].start))
+            m = l + 1;
+        if (m == i)
+            return;
+        tmp = heap[i]; heap[i] = heap[m]; heap[m] = tmp;
+        i = m;
+    }
+}
+
+
+/**
+ * Stream `k` interval sources, each sorted by `start`, through the sweep in
+ * global start order.  Only the current head of each stream is held in
+ * memory.  Does not call `ctimer_iset_finish()`, so more streams (starting no
+ * earlier than the last consumed interval) may be merged afterwards.
+ *
+ * @return 0 on success, -1 if any stream is out of order (remaining intervals
+ * are still consumed), or -2 on allocation failure.
+ */
+static inline
+int ctimer_iset_merge(
+    ctimer_iset_t               * s,    /**<[in,out] sweep state */
+    ctimer_interval_src_t const * srcs, /**<[in]     interval streams */
+    int                   const   k     /**<[in]     number of streams */
+) {
+    ctimer_interval_t * head;
+    int               * heap;
+    int                 n = 0;
+    int                 ret = 0;
+    int                 i;
+
+    if (k <= 0)
+        return 0;
+    head = (ctimer_interval_t *)malloc((size_t)k * sizeof(*head));
+    heap = (int *)malloc((size_t)k * sizeof(*heap));
+    if ((head == NULL) || (heap == NULL)) {
+        free(head);
+        free(heap);
+        return -2;
+    }
+
+    for (i = 0; i < k; ++i)
+        if (srcs[i].next(srcs[i].ctx, &head[i]))
+            heap[n++] = i;
+    for (i = n / 2 - 1; i >= 0; --i)
+        _ctimer_iset_heap_down(head, heap, n, i);
+
+    while (n > 0) {
+        int const j = heap[0];
+        if (ctimer_iset_push(s, head[j]) != 0)
+            ret = -1;
+        if (!srcs[j].next(srcs[j].ctx, &head[j]))
+            heap[0] = heap[--n];
+        _ctimer_iset_heap_down(head, heap, n, 0);
+    }
+
+    free(head);
+    free(heap);
+    return ret;
+}
+
+
+/* ==================================================
+ * QUERIES
+ * ================================================== */
+
+
+/**
+ * Return the length of the union of label `a`'s intervals (nsec).
+ */
+static inline
+long ctimer_iset_union(
+    ctimer_iset_t const * s,    /**<[in] finished sweep */
+    unsigned      const   a     /**<[in] label */
+) {
+    return s->union_len[a];
+}
+
+
+/**
+ * Return the length of the intersection of the unions of labels `a` and `b`
+ * (nsec).  If `a == b`, this is the union length of `a`.
+ */
+static inline
+long ctimer_iset_overlap(
+    ctimer_iset_t const * s,    /**<[in] finished sweep */
+    unsigned      const   a,    /**<[in] label */
+    unsigned      const   b     /**<[in] label */
+) {
+    if (a == b)
+        return s->union_len[a];
+    return (a < b) ? s->overlap[a][b] : s->overlap[b][a];
+}
+
+
+/**
+ * Return the time covered by label `a` but not label `b` (nsec).
+ */
+static inline
+long ctimer_iset_difference(
+    ctimer_iset_t const * s,    /**<[in] finished sweep */
+    unsigned      const   a,    /**<[in] label */
+    unsigned      const   b     /**<[in] label */
+) {
+    return s->union_len[a] - ctimer_iset_overlap(s, a, b);
+}
+
+
+/**
+ * Return the time covered by label `a` and no other label (nsec).
+ */
+static inline
+long ctimer_iset_exclusive(
+    ctimer_iset_t const * s,    /**<[in] finished sweep */
+    unsigned      const   a     /**<[in] label */
+) {
+    return s->exclusive[a];
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_interval */
+
+
+#endif  /* __H_CTIMER_INTERVAL__ */
@@ -0,0 +1,268 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Open-loop latency recording with coordinated-omission correction.
+ *
+ * @file        ctimer_latency.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_LATENCY__
+#define __H_CTIMER_LATENCY__
+
+
+#include <stdio.h>
+
+#include "ctimer.h"
+#include "ctimer_hist.h"
+
+
+/**
+ * @defgroup ctimer_latency Latency recorder API
+ * @ingroup ctimer
+ *
+ * Request latencies measured from their intended start times.
+ *
+ * A load generator that waits for a stalled system sends fewer requests during
+ * the stall, so timing each request from its actual start (with
+ * `ctimer_start()`/`ctimer_stop()`) under-counts exactly the slow period:
+ * "coordinated omission".  A `ctimer_latency_t` recorder takes, with each
+ * completed request, the time the request *should* have started according to
+ * the load schedule, and keeps two histograms:
+ *
+ * - `corrected`: end minus intended start time, i.e. the latency a client
+ *   arriving on schedule would have seen, including time spent waiting for
+ *   the generator to catch up;
+ * - `uncorrected`: end minus actual start time (the service time), as
+ *   measured without correction.
+ *
+ * If the recorder has a non-zero expected `interval` between requests, each
+ * corrected sample is also back-filled with the samples that requests
+ * expected during the stall would have recorded (see
+ * `ctimer_hist_record_expected()`); use this when the generator skips missed
+ * requests instead of sending them late.
+ *
+ * Recorders are single-writer; use one per generator thread and combine them
+ * with `ctimer_latency_merge()`.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Latency recorder struct.
+ */
+typedef struct {
+    ctimer_hist_t corrected;    /**< Latency from intended start (nsec) */
+    ctimer_hist_t uncorrected;  /**< Latency from actual start (nsec) */
+    long          interval;     /**< Expected interval for back-filling
+                                     (nsec), or 0 */
+    unsigned long backfilled;   /**< Back-filled corrected samples */
+    long          max_lag;      /**< Largest actual-minus-intended start
+                                     delay (nsec) */
+} ctimer_latency_t;
+
+
+/**
+ * Allocate an empty latency recorder.  `flags` are passed to
+ * `ctimer_buf_alloc()`.
+ *
+ * @return 0 on success, or -1 on allocation failure
+ *
+ * @sa ctimer_latency_destroy
+ */
+static inline
+int ctimer_latency_init(
+    ctimer_latency_t * l,        /**<[out] latency recorder */
+    long       const   interval, /**<[in]  expected interval between requests
+                                           (nsec) for back-filling; 0 to
+                                           disable */
+    int        const   flags     /**<[in]  `CTIMER_BUF_*` flags */
+) {
+    l->interval   = (interval > 0) ? interval : 0;
+    l->backfilled = 0;
+    l->max_lag    = 0;
+    if (ctimer_hist_init(&l->corrected, flags) != 0)
+        return -1;
+    if (ctimer_hist_init(&l->uncorrected, flags) != 0) {
+        ctimer_hist_destroy(&l->corrected);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Release the histograms of a latency recorder.
+ */
+static inline
+void ctimer_latency_destroy(
+    ctimer_latency_t * l        /**<[in,out] latency recorder */
+) {
+    ctimer_hist_destroy(&l->corrected);
+    ctimer_hist_destroy(&l->uncorrected);
+}
+
+
+/**
+ * Reset a latency recorder to zero samples.
+ */
+static inline
+void ctimer_latency_reset(
+    ctimer_latency_t * l        /**<[in,out] latency recorder */
+) {
+    ctimer_hist_reset(&l->corrected);
+    ctimer_hist_reset(&l->uncorrected);
+    l->backfilled = 0;
+    l->max_lag    = 0;
+}
+
+
+/**
+ * Record one request that was intended to start at `intended`, actually
+ * started at `start`, and completed at `end` (all `CLOCK_MONOTONIC` nsec).
+ * A request started ahead of schedule counts from its actual start.
+ */
+static inline
+void ctimer_latency_record(
+    ctimer_latency_t * l,        /**<[in,out] latency recorder */
+    long       const   intended, /**<[in]     intended start time (nsec) */
+    long       const   start,    /**<[in]     actual start time (nsec) */
+    long       const   end       /**<[in]     completion time (nsec) */
+) {
+    long const lag  = start - intended;
+    long const from = (lag > 0) ? intended : start;
+    ctimer_hist_record(&l->uncorrected, end - start);
+    l->backfilled += ctimer_hist_record_expected(&l->corrected, end - from,
+                                                 l->interval);
+    if (lag > l->max_lag)
+        l->max_lag = lag;
+}
+
+
+/**
+ * Record the request timed by a stopped `ctimer_t` stopwatch, which was
+ * intended to start at `intended`.
+ *
+ * @sa ctimer_latency_stop
+ */
+static inline
+void ctimer_latency_lap(
+    ctimer_latency_t       * l,        /**<[in,out] latency recorder */
+    ctimer_t         const * t,        /**<[in]     stopped stopwatch */
+    struct timespec  const   intended  /**<[in]     intended start time */
+) {
+    ctimer_latency_record(l, timespec_nsec(intended), timespec_nsec(t->start),
+                          timespec_nsec(t->end));
+}
+
+
+/**
+ * Stop a `ctimer_t` stopwatch that timed a request intended to start at
+ * `intended`, and record the request.
+ */
+static inline
+void ctimer_latency_stop(
+    ctimer_latency_t      * l,        /**<[in,out] latency recorder */
+    ctimer_t              * t,        /**<[in,out] stopwatch pointer */
+    struct timespec const   intended  /**<[in]     intended start time */
+) {
+    ctimer_stop(t);
+    ctimer_latency_lap(l, t, intended);
+}
+
+
+/**
+ * Add the samples of latency recorder `src` to `dst`.
+ */
+static inline
+void ctimer_latency_merge(
+    ctimer_latency_t       * dst, /**<[in,out] latency recorder */
+    ctimer_latency_t const * src  /**<[in]     latency recorder */
+) {
+    ctimer_hist_merge(&dst->corrected, &src->corrected);
+    ctimer_hist_merge(&dst->uncorrected, &src->uncorrected);
+    dst->backfilled += src->backfilled;
+    if (src->max_lag > dst->max_lag)
+        dst->max_lag = src->max_lag;
+}
+
+
+/**
+ * Print the corrected and uncorrected histograms of a latency recorder, and
+ * its largest start lag.
+ *
+ * Lines are printed as:
+ * ```
+ * Hist(<label>, corrected) = N samples; p50/p90/p99/p99.9/max = ... nsec
+ * Hist(<label>, uncorrected) = N samples; p50/p90/p99/p99.9/max = ... nsec
+ * Lag(<label>) = max X nsec; B back-filled samples
+ * ```
+ */
+static inline
+void ctimer_latency_print(
+    ctimer_latency_t const * l,     /**<[in] latency recorder */
+    char             const * label  /**<[in] label/description */
+) {
+    char const * const lb = ((label != NULL) && (label[0] != '\0'))
+        ? label : NULL;
+    char               buf[256];
+
+    snprintf(buf, sizeof(buf), "%s%scorrected", lb ? lb : "", lb ? ", " : "");
+    ctimer_hist_print(&l->corrected, buf);
+    snprintf(buf, sizeof(buf), "%s%suncorrected", lb ? lb : "",
+             lb ? ", " : "");
+    ctimer_hist_print(&l->uncorrected, buf);
+    if (lb)
+        printf("Lag(%s) = ", lb);
+    else
+        printf("Lag = ");
+    printf("max %ld nsec; %lu back-filled samples\n", l->max_lag,
+           l->backfilled);
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_latency */
+
+
+#endif  /* __H_CTIMER_LATENCY__ */
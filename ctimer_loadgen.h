@@ -0,0 +1,466 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Open-loop load generator with absolute-deadline pacing and rate sweeps.
+ *
+ * @file        ctimer_loadgen.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_LOADGEN__
+#define __H_CTIMER_LOADGEN__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "ctimer.h"
+#include "ctimer_latency.h"
+
+
+/**
+ * @defgroup ctimer_loadgen Load generator API
+ * @ingroup ctimer
+ *
+ * In-process open-loop load generation and latency-vs-throughput curves.
+ *
+ * `ctimer_loadgen_run()` invokes a user callback at a target total rate,
+ * spread over `threads` threads.  Each thread follows its own schedule of
+ * intended start times: evenly spaced (constant rate, with threads staggered)
+ * or with exponentially distributed gaps (Poisson arrivals).  Threads wait for
+ * each intended time as an absolute `CLOCK_MONOTONIC` deadline (sleeping with
+ * `clock_nanosleep(TIMER_ABSTIME)`, then busy-polling the last `spin` nsec),
+ * and never wait for a late request: a callback that overruns delays the
+ * following requests, which then start late and back to back until the
+ * thread catches up.  Latency is recorded from the intended start time with a
+ * `ctimer_latency_t` recorder, so stalls are charged to every request they
+ * delay (no coordinated omission).
+ *
+ * `ctimer_loadgen_sweep()` runs a sequence of increasing rates and
+ * `ctimer_loadgen_knee()` locates the saturation knee of the resulting curve:
+ * the highest rate that is sustained (achieved throughput within 5% of the
+ * target) with a corrected latency quantile (the median by default) within a
+ * factor (`slack`) of its best value at lower rates.  Tail quantiles are
+ * reported for every rate, but make for a noisy knee criterion.
+ *
+ * @note Requires linking with `-lm` and `-pthread`.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Request callback: perform request number `seq` (per thread) on generator
+ * thread `thread`.
+ */
+typedef void (*ctimer_loadgen_fn_t)(void * arg, int thread, unsigned long seq);
+
+
+/**
+ * Load generator configuration.
+ *
+ * @sa ctimer_loadgen_init
+ */
+typedef struct {
+    ctimer_loadgen_fn_t   fn;       /**< Request callback */
+    void                * arg;      /**< Callback argument */
+    int                   threads;  /**< Generator threads */
+    double                duration; /**< Measured seconds per rate */
+    double                warmup;   /**< Unmeasured seconds before each rate */
+    int                   poisson;  /**< Poisson (1) or constant (0) arrivals */
+    unsigned long         seed;     /**< Seed for Poisson arrivals */
+    long                  spin;     /**< Busy-poll before deadlines (nsec) */
+    double                quantile; /**< Knee latency quantile */
+    double                slack;    /**< Knee latency factor over low load */
+} ctimer_loadgen_t;
+
+
+/**
+ * Result of one load generator run at a fixed target rate.
+ */
+typedef struct {
+    double           rate;      /**< Target rate (requests/sec) */
+    double           achieved;  /**< Completed requests/sec */
+    unsigned long    requests;  /**< Measured requests */
+    unsigned long    late;      /**< Requests started over 1 msec late */
+    ctimer_latency_t latency;   /**< Corrected and uncorrected latencies */
+} ctimer_loadgen_point_t;
+
+
+/**
+ * Initialize a load generator configuration with defaults: 1 thread, 1 sec
+ * per rate after 0.1 sec warmup, constant-rate arrivals, 50 usec busy-poll,
+ * and a knee at twice the lowest median latency.
+ */
+static inline
+void ctimer_loadgen_init(
+    ctimer_loadgen_t    * g,    /**<[out] configuration */
+    ctimer_loadgen_fn_t   fn,   /**<[in]  request callback */
+    void                * arg   /**<[in]  callback argument */
+) {
+    memset(g, 0, sizeof(*g));
+    g->fn       = fn;
+    g->arg      = arg;
+    g->threads  = 1;
+    g->duration = 1.0;
+    g->warmup   = 0.1;
+    g->seed     = 88172645463325252UL;
+    g->spin     = 50000;
+    g->quantile = 0.5;
+    g->slack    = 2.0;
+}
+
+
+/* per-thread generator state */
+typedef struct {
+    ctimer_loadgen_t const * g;
+    pthread_t                tid;
+    int                      thread;
+    double                   period;   /* mean gap between requests (nsec) */
+    long                     first;    /* first intended time (nsec) */
+    long                     measure;  /* start of measured window (nsec) */
+    long                     until;    /* end of schedule (nsec) */
+    long                     last_end; /* completion of last request (nsec) */
+    unsigned long            requests;
+    unsigned long            late;
+    ctimer_latency_t         latency;
+} _ctimer_loadgen_worker_t;
+
+
+/* wait until absolute time `when` (nsec): sleep, then busy-poll the rest */
+static inline
+void _ctimer_loadgen_wait(
+    long const when,
+    long const spin
+) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (when - timespec_nsec(now) > spin) {
+        long const      sleep_until = when - spin;
+        struct timespec ts;
+        ts.tv_sec  = sleep_until / _NSEC_PER_SEC;
+        ts.tv_nsec = sleep_until % _NSEC_PER_SEC;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+               == EINTR)
+            ;
+    }
+    do
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    while (timespec_nsec(now) < when);
+}
+
+
+/* generator thread: follow the schedule of intended times, never skipping
+ * late requests */
+static inline
+void * _ctimer_loadgen_worker(
+    void * arg
+) {
+    _ctimer_loadgen_worker_t * w = (_ctimer_loadgen_worker_t *)arg;
+    unsigned long              x = w->g->seed + 0x9e3779b97f4a7c15UL
+                                   * (unsigned long)(w->thread + 1);
+    double                     intended = (double)w->first;
+    unsigned long              seq;
+    ctimer_t                   t;
+
+    for (seq = 0; (long)intended < w->until; ++seq) {
+        long const due = (long)intended;
+        _ctimer_loadgen_wait(due, w->g->spin);
+        ctimer_start(&t);
+        w->g->fn(w->g->arg, w->thread, seq);
+        ctimer_stop(&t);
+        if (due >= w->measure) {
+            long const start = timespec_nsec(t.start);
+            ctimer_latency_record(&w->latency, due, start,
+                                  timespec_nsec(t.end));
+            w->requests++;
+            w->late += (start - due > 1000000);
+            w->last_end = timespec_nsec(t.end);
+        }
+
+        /* next intended time */
+        if (w->g->poisson) {
+            double u;
+            x ^= x >> 12;       /* xorshift64* */
+            x ^= x << 25;
+            x ^= x >> 27;
+            u = (double)((x * 2685821657736338717UL) >> 11)
+                / 9007199254740992.0;
+            intended += -log(1.0 - u) * w->period;
+        } else {
+            intended += w->period;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Run the load generator at a total target `rate` (requests/sec) for
+ * `warmup + duration` seconds, and store the measured results in `p`.
+ *
+ * @return 0 on success, or -1 on invalid arguments or thread/allocation
+ * failure
+ *
+ * @sa ctimer_loadgen_point_destroy
+ */
+static inline
+int ctimer_loadgen_run(
+    ctimer_loadgen_t       const * g,    /**<[in]  configuration */
+    double                 const   rate, /**<[in]  target rate (requests/sec) */
+    ctimer_loadgen_point_t       * p     /**<[out] results */
+) {
+    int const                  n = (g->threads > 0) ? g->threads : 1;
+    _ctimer_loadgen_worker_t * ws;
+    struct timespec            now;
+    long                       t0, measure, until, last = 0;
+    int                        i, started = 0, ret = 0;
+
+    if ((rate <= 0) || (g->duration <= 0) || (g->fn == NULL))
+        return -1;
+    ws = (_ctimer_loadgen_worker_t *)calloc((size_t)n, sizeof(*ws));
+    if (ws == NULL)
+        return -1;
+    memset(p, 0, sizeof(*p));
+    p->rate = rate;
+    if (ctimer_latency_init(&p->latency, 0, CTIMER_BUF_NO_HUGE) != 0) {
+        free(ws);
+        return -1;
+    }
+
+    /* common schedule origin, slightly in the future so that all threads
+     * are running by then */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    t0      = timespec_nsec(now) + 10 * 1000000L;
+    measure = t0 + (long)(g->warmup * 1e9);
+    until   = measure + (long)(g->duration * 1e9);
+    for (i = 0; i < n; ++i) {
+        _ctimer_loadgen_worker_t * w = &ws[i];
+        w->g       = g;
+        w->thread  = i;
+        w->period  = 1e9 * n / rate;
+        w->first   = t0 + (g->poisson ? 0 : (long)(w->period * i / n));
+        w->measure = measure;
+        w->until   = until;
+        if (ctimer_latency_init(&w->latency, 0, CTIMER_BUF_NO_HUGE) != 0) {
+            ret = -1;
+            break;
+        }
+        if (pthread_create(&w->tid, NULL, _ctimer_loadgen_worker, w) != 0) {
+            ctimer_latency_destroy(&w->latency);
+            ret = -1;
+            break;
+        }
+        ++started;
+    }
+    for (i = 0; i < started; ++i) {
+        pthread_join(ws[i].tid, NULL);
+        ctimer_latency_merge(&p->latency, &ws[i].latency);
+        ctimer_latency_destroy(&ws[i].latency);
+        p->requests += ws[i].requests;
+        p->late     += ws[i].late;
+        if (ws[i].last_end > last)
+            last = ws[i].last_end;
+    }
+    free(ws);
+    if (ret != 0) {
+        ctimer_latency_destroy(&p->latency);
+        return -1;
+    }
+
+    /* throughput over the measured window, or until the last completion if
+     * the generator fell behind */
+    if (last < until)
+        last = until;
+    p->achieved = (double)p->requests * 1e9 / (double)(last - measure);
+    return 0;
+}
+
+
+/**
+ * Release the histograms of a load generator result.
+ */
+static inline
+void ctimer_loadgen_point_destroy(
+    ctimer_loadgen_point_t * p  /**<[in,out] results */
+) {
+    ctimer_latency_destroy(&p->latency);
+}
+
+
+/**
+ * Fill `rates` with `n` geometrically spaced rates from `lo` to `hi`
+ * (requests/sec).
+ */
+static inline
+void ctimer_loadgen_rates(
+    double       * rates,       /**<[out] rates */
+    int    const   n,           /**<[in]  number of rates */
+    double const   lo,          /**<[in]  lowest rate */
+    double const   hi           /**<[in]  highest rate */
+) {
+    int i;
+    for (i = 0; i < n; ++i)
+        rates[i] = (n > 1) ? lo * pow(hi / lo, (double)i / (n - 1)) : lo;
+}
+
+
+/* 1 if result `ps[i]` is saturated: throughput not sustained, or latency
+ * quantile over `slack` times its lowest value at the preceding results */
+static inline
+int _ctimer_loadgen_saturated(
+    ctimer_loadgen_t       const * g,
+    ctimer_loadgen_point_t const * ps,
+    int                    const   i
+) {
+    double const q    = g->quantile;
+    long   const v    = ctimer_hist_percentile(&ps[i].latency.corrected, q);
+    long         base = -1;
+    int          j;
+    if (ps[i].achieved < 0.95 * ps[i].rate)
+        return 1;
+    for (j = 0; j < i; ++j) {
+        long const b = ctimer_hist_percentile(&ps[j].latency.corrected, q);
+        if ((base < 0) || (b < base))
+            base = b;
+    }
+    return (base >= 0) && ((double)v > g->slack * (double)base);
+}
+
+
+/**
+ * Return the index of the saturation knee of a latency-vs-throughput curve:
+ * the last of the first run of unsaturated results (achieved throughput within
+ * 5% of the target rate, and corrected latency at `quantile` at most `slack`
+ * times its lowest value at lower rates).
+ *
+ * @return knee index, or -1 if even the first result is saturated
+ */
+static inline
+int ctimer_loadgen_knee(
+    ctimer_loadgen_t       const * g,   /**<[in] configuration */
+    ctimer_loadgen_point_t const * ps,  /**<[in] results, increasing rates */
+    int                    const   n    /**<[in] number of results */
+) {
+    int i;
+    if ((n < 1) || (ps[0].achieved < 0.95 * ps[0].rate))
+        return -1;
+    for (i = 1; i < n; ++i)
+        if (_ctimer_loadgen_saturated(g, ps, i))
+            break;
+    return i - 1;
+}
+
+
+/**
+ * Run the load generator at each of `n` increasing `rates`, storing results in
+ * `ps`.  The sweep ends early after the first saturated rate (see
+ * `ctimer_loadgen_knee()`), since higher rates only build longer queues.
+ *
+ * @return number of results stored in `ps`
+ *
+ * @sa ctimer_loadgen_print_curve
+ */
+static inline
+int ctimer_loadgen_sweep(
+    ctimer_loadgen_t       const * g,     /**<[in]  configuration */
+    double                 const * rates, /**<[in]  increasing target rates */
+    int                    const   n,     /**<[in]  number of rates */
+    ctimer_loadgen_point_t       * ps     /**<[out] results */
+) {
+    int i;
+    for (i = 0; i < n; ++i) {
+        if (ctimer_loadgen_run(g, rates[i], &ps[i]) != 0)
+            break;
+        if ((i > 0) && _ctimer_loadgen_saturated(g, ps, i)) {
+            ++i;
+            break;
+        }
+    }
+    return i;
+}
+
+
+/**
+ * Print one line per load generator result and the saturation knee.
+ *
+ * Lines are printed as:
+ * ```
+ * Load(<rate>/s) = achieved X/s; p50/p99/p99.9/max = A/B/C/D nsec; uncorrected p99 = E nsec; L late
+ * Knee = <rate>/s
+ * ```
+ */
+static inline
+void ctimer_loadgen_print_curve(
+    ctimer_loadgen_t       const * g,   /**<[in] configuration */
+    ctimer_loadgen_point_t const * ps,  /**<[in] results, increasing rates */
+    int                    const   n    /**<[in] number of results */
+) {
+    int const knee = ctimer_loadgen_knee(g, ps, n);
+    int       i;
+    for (i = 0; i < n; ++i) {
+        ctimer_hist_t const * c = &ps[i].latency.corrected;
+        printf("Load(%.0f/s) = achieved %.0f/s; p50/p99/p99.9/max ="
+               " %ld/%ld/%ld/%ld nsec; uncorrected p99 = %ld nsec;"
+               " %lu late%s\n",
+               ps[i].rate, ps[i].achieved, ctimer_hist_percentile(c, 0.50),
+               ctimer_hist_percentile(c, 0.99),
+               ctimer_hist_percentile(c, 0.999), c->max,
+               ctimer_hist_percentile(&ps[i].latency.uncorrected, 0.99),
+               ps[i].late, (i == knee) ? " <- knee" : "");
+    }
+    if (knee >= 0)
+        printf("Knee = %.0f/s\n", ps[knee].rate);
+    else
+        printf("Knee = none (saturated at lowest rate)\n");
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_loadgen */
+
+
+#endif  /* __H_CTIMER_LOADGEN__ */
@@ -0,0 +1,360 @@
+/* -*- c -*- */
+
+/**
+ * CTimer profile diff: per-scope deltas between two hierarchical profiles.
+ *
+ * Loads two profiles written by `ctimer_scope_dump()` (before and after),
+ * aligns their call-tree nodes by scope path, and prints per-node changes of
+ * inclusive and exclusive time per call, sorted by impact.  The impact of a
+ * node is the change of its exclusive time per call, scaled by its call count
+ * in the second profile; that is, the time it added (or saved) in the second
+ * run, independent of how often it was called.  Nodes found in only one
+ * profile contribute all of their exclusive time.
+ *
+ * With `-f FILE`, also writes a differential flame graph in folded format,
+ * with one line per node:
+ * ```
+ * <path> <before> <after>
+ * ```
+ * where `before` and `after` are exclusive times (nsec), and `before` is
+ * scaled to the call count of the second profile (unless `-r`).  Render it
+ * with `flamegraph.pl FILE > diff.svg`: widths follow the second profile and
+ * colors the change (red slower, blue faster).
+ *
+ * Build and run with:
+ * ```
+ * gcc -O2 -std=gnu99 ctimer_profdiff.c -o ctimer_profdiff
+ * ./ctimer_profdiff [-n rows] [-i] [-r] [-f folded] before.prof after.prof
+ * ```
+ *
+ * Options:
+ * - `-n rows`: number of table rows (default 20; 0 for all nodes)
+ * - `-i`: rank by inclusive instead of exclusive time
+ * - `-r`: do not scale `before` by call counts in the folded output
+ * - `-f folded`: write the differential flame graph to file `folded`
+ *
+ * @file        ctimer_profdiff.c
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* profile node, aligned by path across both profiles ([0]: before, [1]:
+ * after) */
+typedef struct {
+    char const    * path;
+    unsigned long   hash;
+    unsigned long   count[2];
+    double          incl[2];
+    double          excl[2];
+    double          impact;
+} node_t;
+
+
+/* open-addressing hash table of nodes, keyed by path */
+typedef struct {
+    node_t  * nodes;
+    long    * slots;                 /* node index + 1, or 0 if empty */
+    long      n;
+    long      cap;                   /* power of 2 */
+} table_t;
+
+
+static unsigned long hash_path(char const * s) {
+    unsigned long h = 14695981039346656037UL; /* FNV-1a */
+    for (; *s != '\0'; ++s)
+        h = (h ^ (unsigned char)*s) * 1099511628211UL;
+    return h;
+}
+
+
+static int table_grow(table_t * t) {
+    long     cap   = (t->cap > 0) ? 2 * t->cap : 1024;
+    long   * slots = (long *)calloc(cap, sizeof(long));
+    node_t * nodes = (node_t *)realloc(t->nodes, (cap / 2) * sizeof(node_t));
+    long     i;
+    if ((slots == NULL) || (nodes == NULL)) {
+        free(slots);
+        if (nodes != NULL)
+            t->nodes = nodes;
+        return -1;
+    }
+    for (i = 0; i < t->n; ++i) {
+        unsigned long j = nodes[i].hash & (cap - 1);
+        while (slots[j] != 0)
+            j = (j + 1) & (cap - 1);
+        slots[j] = i + 1;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->nodes = nodes;
+    t->cap   = cap;
+    return 0;
+}
+
+
+/* find or insert the node of `path` */
+static node_t * table_get(table_t * t, char const * path) {
+    unsigned long h = hash_path(path);
+    unsigned long j;
+    node_t      * x;
+    if ((2 * (t->n + 1) > t->cap) && (table_grow(t) != 0))
+        return NULL;
+    for (j = h & (t->cap - 1); t->slots[j] != 0; j = (j + 1) & (t->cap - 1)) {
+        x = &t->nodes[t->slots[j] - 1];
+        if ((x->hash == h) && (strcmp(x->path, path) == 0))
+            return x;
+    }
+    x = &t->nodes[t->n++];
+    memset(x, 0, sizeof(*x));
+    x->path     = path;
+    x->hash     = h;
+    t->slots[j] = t->n;
+    return x;
+}
+
+
+/* read file `name` into a NUL-terminated buffer */
+static char * read_file(char const * name) {
+    FILE   * f = fopen(name, "rb");
+    char   * buf;
+    size_t   n = 0, cap = 1 << 20, r;
+    if (f == NULL)
+        return NULL;
+    buf = (char *)malloc(cap);
+    while ((buf != NULL) &&
+           ((r = fread(buf + n, 1, cap - n - 1, f)) > 0)) {
+        n += r;
+        if (n + 1 == cap) {
+            char * b = (char *)realloc(buf, cap *= 2);
+            if (b == NULL)
+                free(buf);
+            buf = b;
+        }
+    }
+    if ((buf != NULL) && ferror(f)) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    if (buf != NULL)
+        buf[n] = '\0';
+    return buf;
+}
+
+
+/* load profile `name` into column `k` of the table; paths point into the
+ * (kept) file buffer */
+static int load(table_t * t, char const * name, int k) {
+    char * buf = read_file(name);
+    char * line, * next;
+    long   lineno = 0, bad = 0;
+    if (buf == NULL) {
+        perror(name);
+        return -1;
+    }
+    for (line = buf; *line != '\0'; line = next) {
+        char          * tab, * end;
+        unsigned long   count;
+        double          incl, excl;
+        node_t        * x;
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+        else
+            next = line + strlen(line);
+        ++lineno;
+        if ((*line == '#') || (*line == '\0'))
+            continue;
+        tab = strchr(line, '\t');
+        if (tab == NULL) {
+            ++bad;
+            continue;
+        }
+        *tab  = '\0';
+        count = strtoul(tab + 1, &end, 10);
+        incl  = strtol(end, &end, 10);
+        excl  = strtol(end, &end, 10);
+        if ((*end != '\0') && (*end != '\r')) {
+            ++bad;
+            continue;
+        }
+        x = table_get(t, line);
+        if (x == NULL) {
+            fprintf(stderr, "ctimer_profdiff: out of memory\n");
+            return -1;
+        }
+        /* repeated paths (e.g., from different threads) are summed */
+        x->count[k] += count;
+        x->incl[k]  += incl;
+        x->excl[k]  += excl;
+    }
+    if (bad > 0)
+        fprintf(stderr, "ctimer_profdiff: %s: skipped %ld malformed lines\n",
+                name, bad);
+    return 0;
+}
+
+
+/* `v[1]` minus `v[0]` scaled to the call count of the second profile */
+static double scaled_delta(node_t const * x, double const * v) {
+    if (x->count[0] == 0)
+        return v[1];
+    if (x->count[1] == 0)
+        return -v[0];
+    return v[1] - v[0] * x->count[1] / x->count[0];
+}
+
+
+static double per_call(double v, unsigned long count) {
+    return (count > 0) ? v / count : 0;
+}
+
+
+static int by_impact(void const * a, void const * b) {
+    double ia = ((node_t const *)a)->impact;
+    double ib = ((node_t const *)b)->impact;
+    ia = (ia < 0) ? -ia : ia;
+    ib = (ib < 0) ? -ib : ib;
+    return (ia < ib) - (ia > ib);
+}
+
+
+/* print the relative change of per-call time, or whether the node is new or
+ * gone */
+static void print_rel(node_t const * x, double const * v) {
+    double a = per_call(v[0], x->count[0]);
+    double b = per_call(v[1], x->count[1]);
+    if (x->count[0] == 0)
+        printf(" %8s", "new");
+    else if (x->count[1] == 0)
+        printf(" %8s", "gone");
+    else if (a == 0)
+        printf(" %8s", "-");
+    else
+        printf(" %+7.1f%%", 100 * (b - a) / a);
+}
+
+
+static void print_table(table_t const * t, long rows) {
+    long i;
+    printf("# %10s %12s %8s %12s %8s %10s %10s  %s\n",
+           "impact(ms)", "dincl/call", "rel", "dexcl/call", "rel",
+           "count0", "count1", "path");
+    for (i = 0; (i < t->n) && ((rows <= 0) || (i < rows)); ++i) {
+        node_t const * x = &t->nodes[i];
+        printf("  %10.3f %12.1f", x->impact * 1e-6,
+               per_call(x->incl[1], x->count[1]) -
+               per_call(x->incl[0], x->count[0]));
+        print_rel(x, x->incl);
+        printf(" %12.1f", per_call(x->excl[1], x->count[1]) -
+               per_call(x->excl[0], x->count[0]));
+        print_rel(x, x->excl);
+        printf(" %10lu %10lu  %s\n", x->count[0], x->count[1], x->path);
+    }
+}
+
+
+static int write_folded(table_t const * t, char const * name, int raw) {
+    FILE * out = fopen(name, "w");
+    long   i;
+    if (out == NULL) {
+        perror(name);
+        return -1;
+    }
+    for (i = 0; i < t->n; ++i) {
+        node_t const * x = &t->nodes[i];
+        double before = ((raw == 0) && (x->count[0] > 0))
+            ? x->excl[0] * x->count[1] / x->count[0] : x->excl[0];
+        fprintf(out, "%s %.0f %.0f\n", x->path, before, x->excl[1]);
+    }
+    if (fclose(out) != 0) {
+        perror(name);
+        return -1;
+    }
+    return 0;
+}
+
+
+int main(int argc, char ** argv) {
+    table_t      t;
+    long         rows   = 20;
+    int          inclusive = 0, raw = 0, opt, k;
+    char const * folded = NULL;
+    double       total[2] = {0, 0};
+    long         only[2]  = {0, 0};
+    long         i;
+
+    while ((opt = getopt(argc, argv, "n:irf:")) != -1) {
+        switch (opt) {
+        case 'n': rows      = atol(optarg); break;
+        case 'i': inclusive = 1;            break;
+        case 'r': raw       = 1;            break;
+        case 'f': folded    = optarg;       break;
+        default:  optind    = argc + 1;     break;
+        }
+    }
+    if (optind + 2 != argc) {
+        fprintf(stderr, "usage: %s [-n rows] [-i] [-r] [-f folded] "
+                "before.prof after.prof\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&t, 0, sizeof(t));
+    for (k = 0; k < 2; ++k)
+        if (load(&t, argv[optind + k], k) != 0)
+            return EXIT_FAILURE;
+
+    for (i = 0; i < t.n; ++i) {
+        node_t * x = &t.nodes[i];
+        x->impact  = scaled_delta(x, inclusive ? x->incl : x->excl);
+        for (k = 0; k < 2; ++k) {
+            total[k] += x->excl[k];
+            only[k]  += (x->count[1-k] == 0);
+        }
+    }
+    qsort(t.nodes, t.n, sizeof(node_t), by_impact);
+
+    printf("# before: %s (%.3f ms)\n", argv[optind],     total[0] * 1e-6);
+    printf("# after:  %s (%.3f ms)\n", argv[optind + 1], total[1] * 1e-6);
+    printf("# nodes:  %ld (%ld only before, %ld only after); "
+           "ranked by %s time\n", t.n, only[0], only[1],
+           inclusive ? "inclusive" : "exclusive");
+    print_table(&t, rows);
+
+    if ((folded != NULL) && (write_folded(&t, folded, raw) != 0))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
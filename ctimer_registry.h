@@ -0,0 +1,389 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Concurrent registry of named CTimer lap statistics.
+ *
+ * @file        ctimer_registry.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_REGISTRY__
+#define __H_CTIMER_REGISTRY__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_registry Registry API
+ * @ingroup ctimer
+ *
+ * Lap statistics created by name at runtime and shared between threads.
+ *
+ * A `ctimer_registry_t` registry maps label strings to `ctimer_stats_t` lap
+ * statistics.  Each name is inserted once, on first use; its entry (with a
+ * private copy of the name) is never moved or freed until the registry is
+ * destroyed, so callers may cache the returned statistics pointer.
+ *
+ * Lookups are lock-free: one string hash, then a linear probe of an index of
+ * entry pointers, which holds at most half as many entries as slots, so a
+ * present name is usually found at the first probe.  Insertions take a mutex
+ * and double-check the index.  When the index becomes half full, inserts
+ * publish a twice as large copy; superseded indexes are kept until the
+ * registry is destroyed, so concurrent readers never see freed memory.
+ *
+ * Statistics are updated with `ctimer_stats_add_atomic()` (or
+ * `ctimer_registry_lap()`).  `ctimer_registry_foreach()` and
+ * `ctimer_registry_print()` enumerate entries in insertion order, concurrently
+ * with insertions.
+ *
+ * @note Requires linking with `-pthread`.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Registry entry: lap statistics and name.
+ */
+typedef struct ctimer_regentry {
+    ctimer_stats_t           stats; /**< Lap statistics (atomically updated) */
+    unsigned long            hash;  /**< Name hash */
+    struct ctimer_regentry * next;  /**< Next entry in insertion order */
+    char const             * name;  /**< Name (copy owned by the entry) */
+} ctimer_regentry_t;
+
+
+/* lookup index; superseded indexes are chained through `prev` */
+typedef struct _ctimer_regindex {
+    unsigned long             mask;
+    struct _ctimer_regindex * prev;
+    ctimer_regentry_t      ** slot;
+} _ctimer_regindex_t;
+
+
+/**
+ * Concurrent named-statistics registry.
+ */
+typedef struct {
+    _ctimer_regindex_t * index; /**< Current lookup index */
+    ctimer_regentry_t  * head;  /**< First entry in insertion order */
+    ctimer_regentry_t  * tail;  /**< Last entry in insertion order */
+    unsigned long        count; /**< Number of entries */
+    pthread_mutex_t      lock;  /**< Serializes insertions */
+} ctimer_registry_t;
+
+
+/* allocate an empty index with `cap` slots (a power of 2) */
+static inline
+_ctimer_regindex_t * _ctimer_regindex_alloc(
+    unsigned long const cap
+) {
+    _ctimer_regindex_t * idx = (_ctimer_regindex_t *)calloc(
+        1, sizeof(_ctimer_regindex_t) + cap * sizeof(ctimer_regentry_t *));
+    if (idx == NULL)
+        return NULL;
+    idx->mask = cap - 1;
+    idx->slot = (ctimer_regentry_t **)(idx + 1);
+    return idx;
+}
+
+
+/**
+ * Initialize an empty registry with room for about `capacity` names before
+ * its index grows.
+ *
+ * @return 0 on success, or -1 on allocation failure
+ *
+ * @sa ctimer_registry_destroy
+ */
+static inline
+int ctimer_registry_init(
+    ctimer_registry_t   * reg,      /**<[out] registry */
+    unsigned long const   capacity  /**<[in]  expected number of names */
+) {
+    unsigned long cap = 16;
+    while (cap < 2 * capacity)
+        cap <<= 1;
+    memset(reg, 0, sizeof(*reg));
+    reg->index = _ctimer_regindex_alloc(cap);
+    if (reg->index == NULL)
+        return -1;
+    pthread_mutex_init(&reg->lock, NULL);
+    return 0;
+}
+
+
+/**
+ * Free a registry and all its entries.  Must not be called concurrently with
+ * any other registry function; all statistics pointers become invalid.
+ */
+static inline
+void ctimer_registry_destroy(
+    ctimer_registry_t * reg     /**<[in,out] registry */
+) {
+    ctimer_regentry_t  * e = reg->head;
+    _ctimer_regindex_t * idx = reg->index;
+    while (e != NULL) {
+        ctimer_regentry_t * next = e->next;
+        free(e);
+        e = next;
+    }
+    while (idx != NULL) {
+        _ctimer_regindex_t * prev = idx->prev;
+        free(idx);
+        idx = prev;
+    }
+    pthread_mutex_destroy(&reg->lock);
+    memset(reg, 0, sizeof(*reg));
+}
+
+
+/* FNV-1a hash of a name */
+static inline
+unsigned long _ctimer_registry_hash(
+    char const * name
+) {
+    unsigned long h = 14695981039346656037UL;
+    for (; *name != '\0'; ++name)
+        h = (h ^ (unsigned char)*name) * 1099511628211UL;
+    return h ^ (h >> 29);
+}
+
+
+/* find `name` (with hash `h`) in an index; NULL if absent */
+static inline
+ctimer_regentry_t * _ctimer_regindex_find(
+    _ctimer_regindex_t const * idx,
+    char               const * name,
+    unsigned long      const   h
+) {
+    unsigned long i;
+    for (i = h & idx->mask; ; i = (i + 1) & idx->mask) {
+        ctimer_regentry_t * e = __atomic_load_n(&idx->slot[i],
+                                                __ATOMIC_ACQUIRE);
+        if (e == NULL)
+            return NULL;
+        if ((e->hash == h) && (strcmp(e->name, name) == 0))
+            return e;
+    }
+}
+
+
+/* put entry `e` in an index with free slots (under the registry lock) */
+static inline
+void _ctimer_regindex_put(
+    _ctimer_regindex_t * idx,
+    ctimer_regentry_t  * e
+) {
+    unsigned long i = e->hash & idx->mask;
+    while (idx->slot[i] != NULL)
+        i = (i + 1) & idx->mask;
+    __atomic_store_n(&idx->slot[i], e, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Return the lap statistics named `name`, or NULL if there are none.
+ * Lock-free.
+ *
+ * @sa ctimer_registry_get
+ */
+static inline
+ctimer_stats_t * ctimer_registry_find(
+    ctimer_registry_t       * reg,  /**<[in] registry */
+    char              const * name  /**<[in] name */
+) {
+    _ctimer_regindex_t const * idx = __atomic_load_n(&reg->index,
+                                                     __ATOMIC_ACQUIRE);
+    ctimer_regentry_t        * e   = _ctimer_regindex_find(
+        idx, name, _ctimer_registry_hash(name));
+    return (e != NULL) ? &e->stats : NULL;
+}
+
+
+/**
+ * Return the lap statistics named `name`, creating them (with zero laps) on
+ * first use.  Lock-free if the name exists; otherwise takes the registry
+ * lock.  The returned pointer stays valid until the registry is destroyed.
+ *
+ * @return statistics pointer, or NULL on allocation failure
+ */
+static inline
+ctimer_stats_t * ctimer_registry_get(
+    ctimer_registry_t       * reg,  /**<[in,out] registry */
+    char              const * name  /**<[in]     name */
+) {
+    unsigned long const  h   = _ctimer_registry_hash(name);
+    _ctimer_regindex_t * idx = __atomic_load_n(&reg->index, __ATOMIC_ACQUIRE);
+    ctimer_regentry_t  * e   = _ctimer_regindex_find(idx, name, h);
+    size_t               len;
+
+    if (e != NULL)
+        return &e->stats;
+
+    pthread_mutex_lock(&reg->lock);
+    idx = reg->index;
+    e   = _ctimer_regindex_find(idx, name, h); /* inserted meanwhile? */
+    if (e != NULL) {
+        pthread_mutex_unlock(&reg->lock);
+        return &e->stats;
+    }
+
+    /* keep the index at most half full: publish a larger copy */
+    if (2 * (reg->count + 1) > idx->mask + 1) {
+        _ctimer_regindex_t * big = _ctimer_regindex_alloc(2 * (idx->mask + 1));
+        ctimer_regentry_t  * x;
+        if (big == NULL) {
+            pthread_mutex_unlock(&reg->lock);
+            return NULL;
+        }
+        for (x = reg->head; x != NULL; x = x->next)
+            _ctimer_regindex_put(big, x);
+        big->prev = idx;
+        __atomic_store_n(&reg->index, big, __ATOMIC_RELEASE);
+        idx = big;
+    }
+
+    len = strlen(name);
+    e   = (ctimer_regentry_t *)malloc(sizeof(ctimer_regentry_t) + len + 1);
+    if (e == NULL) {
+        pthread_mutex_unlock(&reg->lock);
+        return NULL;
+    }
+    ctimer_stats_reset(&e->stats);
+    e->hash = h;
+    e->next = NULL;
+    e->name = (char const *)memcpy((char *)(e + 1), name, len + 1);
+
+    /* publish in insertion order, then in the index */
+    if (reg->tail != NULL)
+        __atomic_store_n(&reg->tail->next, e, __ATOMIC_RELEASE);
+    else
+        __atomic_store_n(&reg->head, e, __ATOMIC_RELEASE);
+    reg->tail = e;
+    __atomic_store_n(&reg->count, reg->count + 1, __ATOMIC_RELAXED);
+    _ctimer_regindex_put(idx, e);
+    pthread_mutex_unlock(&reg->lock);
+    return &e->stats;
+}
+
+
+/**
+ * Return the name of registry statistics `s` (a pointer returned by
+ * `ctimer_registry_get()` or `ctimer_registry_find()`).
+ */
+static inline
+char const * ctimer_registry_name(
+    ctimer_stats_t const * s    /**<[in] registry statistics */
+) {
+    return ((ctimer_regentry_t const *)s)->name;
+}
+
+
+/**
+ * Add the `start`-to-`end` duration of a stopped `ctimer_t` stopwatch to
+ * registry statistics, using relaxed atomic operations.
+ */
+static inline
+void ctimer_registry_lap(
+    ctimer_stats_t       * s,   /**<[in,out] registry statistics */
+    ctimer_t       const * t    /**<[in]     stopped stopwatch */
+) {
+    ctimer_stats_add_atomic(s, timespec_nsec(t->end) - timespec_nsec(t->start));
+}
+
+
+/**
+ * Call `fn(name, stats, arg)` for each entry of a registry in insertion
+ * order, with a snapshot of its statistics.  Lock-free; entries inserted
+ * during the enumeration may or may not be visited.
+ */
+static inline
+void ctimer_registry_foreach(
+    ctimer_registry_t * reg,                 /**<[in] registry */
+    void (*fn)(char const * name, ctimer_stats_t const * stats, void * arg),
+                                             /**<[in] callback */
+    void              * arg                  /**<[in] callback argument */
+) {
+    ctimer_regentry_t * e = __atomic_load_n(&reg->head, __ATOMIC_ACQUIRE);
+    for (; e != NULL; e = __atomic_load_n(&e->next, __ATOMIC_ACQUIRE)) {
+        ctimer_stats_t const snap = ctimer_stats_load(&e->stats);
+        fn(e->name, &snap, arg);
+    }
+}
+
+
+/* ctimer_registry_foreach() callback for ctimer_registry_print() */
+static inline
+void _ctimer_registry_print_one(
+    char           const * name,
+    ctimer_stats_t const * stats,
+    void                 * arg
+) {
+    (void)arg;
+    ctimer_stats_print(stats, name);
+}
+
+
+/**
+ * Print the statistics of each registry entry in insertion order (see
+ * `ctimer_stats_print()`).
+ */
+static inline
+void ctimer_registry_print(
+    ctimer_registry_t * reg     /**<[in] registry */
+) {
+    ctimer_registry_foreach(reg, _ctimer_registry_print_one, NULL);
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_registry */
+
+
+#endif  /* __H_CTIMER_REGISTRY__ */
@@ -0,0 +1,537 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * CTimer sampling profiler: CPU-time samples attributed to the active scope.
+ *
+ * @file        ctimer_sampler.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_SAMPLER__
+#define __H_CTIMER_SAMPLER__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <dlfcn.h>
+#include <sys/syscall.h>
+
+#include "ctimer.h"
+#include "ctimer_scope.h"
+
+
+/**
+ * @defgroup ctimer_sampler Sampling profiler API
+ * @ingroup ctimer
+ *
+ * Statistical profiling within `ctimer_scope.h` scopes.
+ *
+ * `ctimer_sampler_start(period, capacity)` arms a per-thread POSIX timer on
+ * the calling thread's CPU-time clock (`CLOCK_THREAD_CPUTIME_ID`), delivering
+ * `CTIMER_SAMPLER_SIGNAL` (`SIGPROF`) to that thread every `period` nsec of
+ * its CPU time.  On each signal, the handler records the innermost active
+ * scope (its call-tree node, which identifies the whole scope stack) and the
+ * interrupted program counter into a single-producer ring of the thread,
+ * without locks or allocation; samples are dropped (and counted) if the ring
+ * is full.  `ctimer_sampler_stop()` disarms the timer of the calling thread;
+ * it must be called before the thread exits.
+ *
+ * `ctimer_sampler_report(out, top)` drains the rings of all threads (it may
+ * run concurrently with sampling) and prints the number of samples per scope
+ * path, each followed by its `top` most frequent program counters:
+ * ```
+ * Samples(main;solve;lu) = 812 (64.2%)
+ *          301 ( 37.1%)  0x55d0c1a0e3f4  prog+0x13f4 lu_kernel+0x24
+ * ```
+ * Samples outside any scope are reported under `(no scope)`.  Program
+ * counters are symbolized with `dladdr()` when `_GNU_SOURCE` is defined
+ * before the first system header; the `module+offset` form can be passed to
+ * `addr2line -e module`.  With glibc before 2.34, link with `-ldl` (and
+ * `-lrt` for `timer_create()` before 2.17).
+ *
+ * @warning Sampling works on Linux only.  Program counters are read from the
+ * signal context on x86-64 and AArch64 (0 elsewhere).
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Profiling signal.  May be overridden. */
+#ifndef CTIMER_SAMPLER_SIGNAL
+#define CTIMER_SAMPLER_SIGNAL SIGPROF
+#endif
+
+/** Default per-thread ring capacity (samples).  May be overridden. */
+#ifndef CTIMER_SAMPLER_CAPACITY
+#define CTIMER_SAMPLER_CAPACITY (1L << 16)
+#endif
+
+/* target thread of SIGEV_THREAD_ID timers (not named by older glibc) */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+
+/**
+ * Profiling sample.
+ */
+typedef struct {
+    ctimer_scope_node_t const * scope; /**< Innermost scope (NULL if none) */
+    void                      * pc;    /**< Interrupted program counter */
+} ctimer_sample_t;
+
+
+/**
+ * Per-thread sampler state.
+ */
+typedef struct ctimer_sampler {
+    ctimer_sample_t       * buf;       /**< Sample ring */
+    unsigned long           mask;      /**< Ring capacity - 1 */
+    unsigned long           head;      /**< Samples written (by handler) */
+    unsigned long           tail;      /**< Samples read (by reports) */
+    unsigned long           dropped;   /**< Samples dropped (ring full) */
+    timer_t                 timer;     /**< CPU-time timer */
+    int                     armed;     /**< Timer armed? */
+    struct ctimer_sampler * next;      /**< Next thread state */
+} ctimer_sampler_t;
+
+
+/* calling thread's state, and list of all thread states; weak, so all
+ * translation units share them */
+__attribute__((weak)) __thread ctimer_sampler_t * _ctimer_sampler_self;
+__attribute__((weak)) ctimer_sampler_t * _ctimer_sampler_threads;
+
+
+/* interrupted program counter of signal context `uc` */
+static inline
+void * _ctimer_sampler_pc(
+    void * uc
+) {
+#if defined(__x86_64__) && defined(__linux__)
+#ifdef REG_RIP
+    return (void *)((ucontext_t *)uc)->uc_mcontext.gregs[REG_RIP];
+#else
+    return (void *)((ucontext_t *)uc)->uc_mcontext.gregs[16]; /* REG_RIP */
+#endif
+#elif defined(__aarch64__) && defined(__linux__)
+    return (void *)((ucontext_t *)uc)->uc_mcontext.pc;
+#else
+    (void)uc;
+    return NULL;
+#endif
+}
+
+
+/* signal handler: append the current scope and PC to the thread's ring */
+static inline
+void _ctimer_sampler_handler(
+    int         sig,
+    siginfo_t * info,
+    void      * uc
+) {
+    ctimer_sampler_t * s = _ctimer_sampler_self;
+    unsigned long      h;
+    (void)sig;
+    (void)info;
+    if (s == NULL)
+        return;
+    h = s->head;
+    if (h - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE) > s->mask) {
+        __atomic_fetch_add(&s->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    s->buf[h & s->mask].scope = ctimer_scope_current();
+    s->buf[h & s->mask].pc    = _ctimer_sampler_pc(uc);
+    __atomic_store_n(&s->head, h + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Start sampling the calling thread every `period` nsec of its CPU time.
+ * The ring of the thread is allocated on its first call, with `capacity`
+ * samples (rounded up to a power of 2; `CTIMER_SAMPLER_CAPACITY` if 0).
+ *
+ * @return 0 on success, or -1 on failure (with `errno` set)
+ */
+static inline
+int ctimer_sampler_start(
+    long period,                /**<[in] sampling period (nsec of CPU time) */
+    long capacity               /**<[in] ring capacity (samples), or 0 */
+) {
+    ctimer_sampler_t  * s = _ctimer_sampler_self;
+    struct sigaction    sa;
+    struct sigevent     ev;
+    struct itimerspec   its;
+
+    /* the handler must not allocate the scope state */
+    if (ctimer_scope_thread() == NULL)
+        return -1;
+    if (s == NULL) {
+        unsigned long cap = 1;
+        if (capacity <= 0)
+            capacity = CTIMER_SAMPLER_CAPACITY;
+        while (cap < (unsigned long)capacity)
+            cap <<= 1;
+        s = (ctimer_sampler_t *)calloc(1, sizeof(ctimer_sampler_t));
+        if (s == NULL)
+            return -1;
+        s->buf = (ctimer_sample_t *)malloc(cap * sizeof(ctimer_sample_t));
+        if (s->buf == NULL) {
+            free(s);
+            return -1;
+        }
+        s->mask = cap - 1;
+        s->next = __atomic_load_n(&_ctimer_sampler_threads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&_ctimer_sampler_threads,
+                                            &s->next, s, 1, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+            ;
+        _ctimer_sampler_self = s;
+    }
+    if (s->armed)
+        return 0;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = _ctimer_sampler_handler;
+    sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(CTIMER_SAMPLER_SIGNAL, &sa, NULL) != 0)
+        return -1;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.sigev_notify           = SIGEV_THREAD_ID;
+    ev.sigev_signo            = CTIMER_SAMPLER_SIGNAL;
+    ev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &ev, &s->timer) != 0)
+        return -1;
+
+    if (period <= 0)
+        period = 1;
+    its.it_interval.tv_sec  = period / 1000000000L;
+    its.it_interval.tv_nsec = period % 1000000000L;
+    its.it_value            = its.it_interval;
+    if (timer_settime(s->timer, 0, &its, NULL) != 0) {
+        timer_delete(s->timer);
+        return -1;
+    }
+    s->armed = 1;
+    return 0;
+}
+
+
+/**
+ * Stop sampling the calling thread.  Its samples remain available to
+ * `ctimer_sampler_report()`.
+ */
+static inline
+void ctimer_sampler_stop(void) {
+    ctimer_sampler_t * s = _ctimer_sampler_self;
+    if ((s == NULL) || !s->armed)
+        return;
+    timer_delete(s->timer);
+    s->armed = 0;
+}
+
+
+/* sample with the (report-local) identifier of its scope path */
+typedef struct {
+    long   id;
+    void * pc;
+} _ctimer_sample_id_t;
+
+/* samples of one scope node (`first`: offset in sorted samples) or, after
+ * collapsing, of one scope path (`first`: offset of its PC counts) */
+typedef struct {
+    ctimer_scope_node_t const * scope;
+    char                      * path;
+    long                        id;
+    long                        first;
+    long                        count;
+} _ctimer_sampler_scope_t;
+
+/* samples of one program counter within a scope path */
+typedef struct {
+    void * pc;
+    long   count;
+} _ctimer_sampler_pc_t;
+
+
+static inline
+int _ctimer_sampler_cmp_node(
+    void const * a,
+    void const * b
+) {
+    ctimer_scope_node_t const * x = ((ctimer_sample_t const *)a)->scope;
+    ctimer_scope_node_t const * y = ((ctimer_sample_t const *)b)->scope;
+    return (x > y) - (x < y);
+}
+
+static inline
+int _ctimer_sampler_cmp_path(
+    void const * a,
+    void const * b
+) {
+    return strcmp(((_ctimer_sampler_scope_t const *)a)->path,
+                  ((_ctimer_sampler_scope_t const *)b)->path);
+}
+
+static inline
+int _ctimer_sampler_cmp_id(
+    void const * a,
+    void const * b
+) {
+    _ctimer_sample_id_t const * x = (_ctimer_sample_id_t const *)a;
+    _ctimer_sample_id_t const * y = (_ctimer_sample_id_t const *)b;
+    if (x->id != y->id)
+        return (x->id > y->id) - (x->id < y->id);
+    return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+static inline
+int _ctimer_sampler_cmp_scope_count(
+    void const * a,
+    void const * b
+) {
+    long x = ((_ctimer_sampler_scope_t const *)a)->count;
+    long y = ((_ctimer_sampler_scope_t const *)b)->count;
+    return (x < y) - (x > y);
+}
+
+static inline
+int _ctimer_sampler_cmp_pc_count(
+    void const * a,
+    void const * b
+) {
+    long x = ((_ctimer_sampler_pc_t const *)a)->count;
+    long y = ((_ctimer_sampler_pc_t const *)b)->count;
+    return (x < y) - (x > y);
+}
+
+
+/* `;`-separated scope path of node `n` (malloc'd) */
+static inline
+char * _ctimer_sampler_path(
+    ctimer_scope_node_t const * n
+) {
+    ctimer_scope_node_t const * p;
+    size_t                      len = 0;
+    char                      * path, * end;
+    if ((n == NULL) || (n->parent == NULL))
+        return strdup("(no scope)");
+    for (p = n; p->parent != NULL; p = p->parent)
+        len += strlen(p->name) + 1;
+    path = (char *)malloc(len);
+    if (path == NULL)
+        return NULL;
+    end  = path + len - 1;
+    *end = '\0';
+    for (p = n; p->parent != NULL; p = p->parent) {
+        size_t l = strlen(p->name);
+        end -= l;
+        memcpy(end, p->name, l);
+        if (p->parent->parent != NULL)
+            *--end = ';';
+    }
+    return path;
+}
+
+
+/* print program counter `pc`, symbolized if possible */
+static inline
+void _ctimer_sampler_print_pc(
+    FILE * out,
+    void * pc
+) {
+    fprintf(out, "%p", pc);
+#ifdef LM_ID_BASE  /* dladdr() is declared (with _GNU_SOURCE) */
+    {
+        Dl_info info;
+        if ((pc != NULL) && (dladdr(pc, &info) != 0) &&
+            (info.dli_fname != NULL)) {
+            char const * mod = strrchr(info.dli_fname, '/');
+            fprintf(out, "  %s+0x%lx", (mod != NULL) ? mod + 1 : info.dli_fname,
+                    (unsigned long)((char *)pc - (char *)info.dli_fbase));
+            if (info.dli_sname != NULL)
+                fprintf(out, " %s+0x%lx", info.dli_sname,
+                        (unsigned long)((char *)pc - (char *)info.dli_saddr));
+        }
+    }
+#endif
+}
+
+
+/**
+ * Drain the sample rings of all threads, and print sample counts per scope
+ * path (most sampled first) with the `top` most frequent program counters
+ * of each.
+ *
+ * @return number of samples reported, or -1 on allocation failure
+ */
+static inline
+long ctimer_sampler_report(
+    FILE * out,                 /**<[in] output stream */
+    int    top                  /**<[in] PCs listed per scope */
+) {
+    ctimer_sampler_t        * s;
+    ctimer_sample_t         * smp;
+    _ctimer_sample_id_t     * ids;
+    _ctimer_sampler_scope_t * scp;
+    _ctimer_sampler_pc_t    * pcs;
+    unsigned long             dropped = 0;
+    long                      n = 0, nscp = 0, npath = 0, npc = 0, i, j, k;
+
+    for (s = __atomic_load_n(&_ctimer_sampler_threads, __ATOMIC_ACQUIRE);
+         s != NULL; s = s->next)
+        n += __atomic_load_n(&s->head, __ATOMIC_ACQUIRE) - s->tail;
+    smp = (ctimer_sample_t *)malloc((n + 1) * sizeof(ctimer_sample_t));
+    ids = (_ctimer_sample_id_t *)malloc((n + 1) * sizeof(_ctimer_sample_id_t));
+    scp = (_ctimer_sampler_scope_t *)
+        malloc((n + 1) * sizeof(_ctimer_sampler_scope_t));
+    pcs = (_ctimer_sampler_pc_t *)
+        malloc((n + 1) * sizeof(_ctimer_sampler_pc_t));
+    if ((smp == NULL) || (ids == NULL) || (scp == NULL) || (pcs == NULL)) {
+        free(smp);
+        free(ids);
+        free(scp);
+        free(pcs);
+        return -1;
+    }
+
+    /* drain the rings (up to the samples counted above) */
+    i = 0;
+    for (s = __atomic_load_n(&_ctimer_sampler_threads, __ATOMIC_ACQUIRE);
+         s != NULL; s = s->next) {
+        unsigned long h = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+        unsigned long t = s->tail;
+        for (; (t != h) && (i < n); ++t)
+            smp[i++] = s->buf[t & s->mask];
+        __atomic_store_n(&s->tail, t, __ATOMIC_RELEASE);
+        dropped += __atomic_load_n(&s->dropped, __ATOMIC_RELAXED);
+    }
+    n = i;
+
+    /* group samples by scope node, then number distinct paths (nodes of
+     * different threads may share a path) */
+    qsort(smp, n, sizeof(ctimer_sample_t), _ctimer_sampler_cmp_node);
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; (j < n) && (smp[j].scope == smp[i].scope); ++j)
+            ;
+        scp[nscp].scope = smp[i].scope;
+        scp[nscp].path  = _ctimer_sampler_path(smp[i].scope);
+        scp[nscp].first = i;
+        scp[nscp].count = j - i;
+        if (scp[nscp].path == NULL)
+            scp[nscp].path = strdup("?");
+        ++nscp;
+    }
+    qsort(scp, nscp, sizeof(_ctimer_sampler_scope_t),
+          _ctimer_sampler_cmp_path);
+    for (i = 0, k = 0; i < nscp; ++i) {
+        if ((i > 0) && (strcmp(scp[i].path, scp[i-1].path) == 0))
+            scp[i].id = scp[i-1].id;
+        else
+            scp[i].id = npath++;
+        for (j = scp[i].first; j < scp[i].first + scp[i].count; ++j, ++k) {
+            ids[k].id = scp[i].id;
+            ids[k].pc = smp[j].pc;
+        }
+    }
+
+    /* collapse scope entries to one per path, in id order */
+    for (i = 0, k = 0; i < nscp; ++i) {
+        if ((k > 0) && (scp[k-1].id == scp[i].id)) {
+            scp[k-1].count += scp[i].count;
+            free(scp[i].path);
+        } else
+            scp[k++] = scp[i];
+    }
+
+    /* count samples per (path, PC); the PCs of each path are contiguous */
+    qsort(ids, n, sizeof(_ctimer_sample_id_t), _ctimer_sampler_cmp_id);
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; (j < n) && (ids[j].id == ids[i].id) &&
+                 (ids[j].pc == ids[i].pc); ++j)
+            ;
+        if ((i == 0) || (ids[i].id != ids[i-1].id))
+            scp[ids[i].id].first = npc;
+        pcs[npc].pc      = ids[i].pc;
+        pcs[npc++].count = j - i;
+    }
+
+    qsort(scp, npath, sizeof(_ctimer_sampler_scope_t),
+          _ctimer_sampler_cmp_scope_count);
+    fprintf(out, "Samples = %ld (%lu dropped)\n", n, dropped);
+    for (i = 0; i < npath; ++i) {
+        long last = scp[i].first;
+        for (k = 0; k < scp[i].count; k += pcs[last++].count)
+            ;
+        fprintf(out, "Samples(%s) = %ld (%.1f%%)\n", scp[i].path,
+                scp[i].count, 100.0 * scp[i].count / n);
+        qsort(pcs + scp[i].first, last - scp[i].first,
+              sizeof(_ctimer_sampler_pc_t), _ctimer_sampler_cmp_pc_count);
+        for (j = scp[i].first; (j < last) && (j - scp[i].first < top); ++j) {
+            fprintf(out, "    %8ld (%5.1f%%)  ", pcs[j].count,
+                    100.0 * pcs[j].count / scp[i].count);
+            _ctimer_sampler_print_pc(out, pcs[j].pc);
+            fputc('\n', out);
+        }
+        free(scp[i].path);
+    }
+
+    free(pcs);
+    free(scp);
+    free(ids);
+    free(smp);
+    return n;
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_sampler */
+
+
+#endif  /* __H_CTIMER_SAMPLER__ */
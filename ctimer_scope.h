@@ -0,0 +1,363 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Hierarchical CTimer scopes: per-thread scope stacks and call-tree profiles.
+ *
+ * @file        ctimer_scope.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_SCOPE__
+#define __H_CTIMER_SCOPE__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_scope Scope profile API
+ * @ingroup ctimer
+ *
+ * Nested timed scopes aggregated into per-thread call trees.
+ *
+ * `ctimer_scope_enter(name)` and `ctimer_scope_exit()` delimit a timed scope
+ * on the calling thread.  Each thread keeps a stack of active scopes and a
+ * call tree with one node per distinct scope path (e.g., `main;solve;lu`);
+ * each node accumulates its activation count and inclusive time, and the time
+ * spent in child scopes, from which exclusive time follows.  Entering and
+ * exiting a scope read the clock once each and touch only the calling
+ * thread's tree, without locks; nodes are allocated from per-thread blocks.
+ * Scope names are compared by pointer first, so string literals make lookups
+ * cheap.
+ *
+ * The trees of all threads (including finished ones) are kept until the end
+ * of the program.  `ctimer_scope_dump()` writes them as a text profile, with
+ * one line per node:
+ * ```
+ * # ctimer profile 1
+ * <path>\t<count>\t<inclusive nsec>\t<exclusive nsec>
+ * ```
+ * where `path` is the `;`-separated list of scope names from the root (as in
+ * folded stack traces).  Lines for the same path from different threads may
+ * repeat; readers sum them.  `ctimer_profdiff` compares two such profiles.
+ *
+ * @warning Dumps read other threads' trees without synchronization: dump
+ * after the profiled threads finish (or stop entering new scopes) for exact
+ * counts.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Call-tree nodes allocated per block.  May be overridden. */
+#ifndef CTIMER_SCOPE_BLOCK
+#define CTIMER_SCOPE_BLOCK 256
+#endif
+
+
+/**
+ * Call-tree node: one scope path on one thread.
+ */
+typedef struct ctimer_scope_node {
+    char const                * name;    /**< Scope name */
+    struct ctimer_scope_node  * parent;  /**< Enclosing scope (NULL at root) */
+    struct ctimer_scope_node  * child;   /**< First child scope */
+    struct ctimer_scope_node  * sibling; /**< Next sibling scope */
+    unsigned long               count;   /**< Completed activations */
+    long                        incl;    /**< Inclusive time (nsec) */
+    long                        inner;   /**< Time in child scopes (nsec) */
+    long                        start;   /**< Start of current activation */
+    int                         depth;   /**< Depth (root is 0) */
+} ctimer_scope_node_t;
+
+
+/**
+ * Per-thread scope state: call tree and current scope.
+ */
+typedef struct ctimer_scope_thread {
+    ctimer_scope_node_t          root;  /**< Call-tree root (not a scope) */
+    ctimer_scope_node_t        * cur;   /**< Innermost active scope */
+    ctimer_scope_node_t        * free;  /**< Next unused node of block */
+    ctimer_scope_node_t        * end;   /**< End of current block */
+    long                         lost;  /**< Depth of unrecorded scopes */
+    long                         tid;   /**< Thread number (creation order) */
+    struct ctimer_scope_thread * next;  /**< Next thread state */
+} ctimer_scope_thread_t;
+
+
+/* calling thread's state, and list of all thread states; weak, so all
+ * translation units share them */
+__attribute__((weak)) __thread ctimer_scope_thread_t * _ctimer_scope_self;
+__attribute__((weak)) ctimer_scope_thread_t * _ctimer_scope_threads;
+__attribute__((weak)) long _ctimer_scope_nthreads;
+
+
+/**
+ * Return the calling thread's scope state, creating it on first use.
+ *
+ * @return thread state, or NULL on allocation failure
+ */
+static inline
+ctimer_scope_thread_t * ctimer_scope_thread(void) {
+    ctimer_scope_thread_t * th = _ctimer_scope_self;
+    if (__builtin_expect(th != NULL, 1))
+        return th;
+    th = (ctimer_scope_thread_t *)calloc(1, sizeof(ctimer_scope_thread_t));
+    if (th == NULL)
+        return NULL;
+    th->root.name = "";
+    th->cur       = &th->root;
+    th->tid       = __atomic_fetch_add(&_ctimer_scope_nthreads, 1,
+                                       __ATOMIC_RELAXED);
+    th->next      = __atomic_load_n(&_ctimer_scope_threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&_ctimer_scope_threads, &th->next, th,
+                                        1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    _ctimer_scope_self = th;
+    return th;
+}
+
+
+/* find or create the child scope `name` of `parent` */
+static inline
+ctimer_scope_node_t * _ctimer_scope_child(
+    ctimer_scope_thread_t * th,
+    ctimer_scope_node_t   * parent,
+    char            const * name
+) {
+    ctimer_scope_node_t * c;
+    for (c = parent->child; c != NULL; c = c->sibling)
+        if (c->name == name)
+            return c;
+    for (c = parent->child; c != NULL; c = c->sibling)
+        if (strcmp(c->name, name) == 0)
+            return c;
+    if (th->free == th->end) {
+        th->free = (ctimer_scope_node_t *)calloc(CTIMER_SCOPE_BLOCK,
+                                                 sizeof(ctimer_scope_node_t));
+        if (th->free == NULL) {
+            th->end = NULL;
+            return NULL;
+        }
+        th->end = th->free + CTIMER_SCOPE_BLOCK;
+    }
+    c          = th->free++;
+    c->name    = name;
+    c->parent  = parent;
+    c->depth   = parent->depth + 1;
+    c->sibling = parent->child;
+    /* the node is complete before it becomes reachable (e.g., from a signal
+     * handler walking the tree of this thread) */
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    parent->child = c;
+    return c;
+}
+
+
+/**
+ * Enter scope `name` on the calling thread.  Scopes must be properly nested.
+ *
+ * If no call-tree node can be allocated for the scope, the scope and any
+ * scopes nested in it are not recorded (their time is charged to the
+ * enclosing scope), and the matching exits only undo their entries.
+ *
+ * @sa ctimer_scope_exit
+ */
+static inline
+void ctimer_scope_enter(
+    char const * name           /**<[in] scope name (kept by pointer) */
+) {
+    ctimer_scope_thread_t * th = ctimer_scope_thread();
+    ctimer_scope_node_t   * c;
+    struct timespec         now;
+    if (th == NULL)
+        return;
+    if (th->lost > 0) {
+        th->lost++;
+        return;
+    }
+    c = _ctimer_scope_child(th, th->cur, name);
+    if (c == NULL) {
+        th->lost = 1;
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    c->start = timespec_nsec(now);
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    th->cur = c;
+}
+
+
+/**
+ * Exit the innermost scope of the calling thread.
+ *
+ * @sa ctimer_scope_enter
+ */
+static inline
+void ctimer_scope_exit(void) {
+    ctimer_scope_thread_t * th = _ctimer_scope_self;
+    ctimer_scope_node_t   * c;
+    struct timespec         now;
+    long                    d;
+    if (th == NULL)
+        return;
+    if (th->lost > 0) {
+        th->lost--;
+        return;
+    }
+    if (th->cur == &th->root)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    c  = th->cur;
+    d  = timespec_nsec(now) - c->start;
+    c->count++;
+    c->incl          += d;
+    c->parent->inner += d;
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    th->cur = c->parent;
+}
+
+
+/**
+ * Return the innermost active scope of the calling thread (its root node if
+ * no scope is active), or NULL if the thread never entered a scope.
+ * Async-signal-safe.
+ */
+static inline
+ctimer_scope_node_t const * ctimer_scope_current(void) {
+    ctimer_scope_thread_t * th = _ctimer_scope_self;
+    return (th != NULL) ? th->cur : NULL;
+}
+
+
+/* write the name of scope `n` with profile separators replaced */
+static inline
+void _ctimer_scope_put_name(
+    FILE       * out,
+    char const * name
+) {
+    for (; *name != '\0'; ++name)
+        fputc(((*name == ';') || (*name == '\t') || (*name == '\n'))
+              ? '_' : *name, out);
+}
+
+
+/* write the path of node `n` from the root */
+static inline
+void _ctimer_scope_put_path(
+    FILE                      * out,
+    ctimer_scope_node_t const * n
+) {
+    if ((n->parent != NULL) && (n->parent->parent != NULL)) {
+        _ctimer_scope_put_path(out, n->parent);
+        fputc(';', out);
+    }
+    _ctimer_scope_put_name(out, n->name);
+}
+
+
+/**
+ * Write the call trees of all threads to `out` as a text profile (see the
+ * format above).  Nodes without completed activations are omitted.
+ *
+ * @return number of nodes written
+ */
+static inline
+long ctimer_scope_dump(
+    FILE * out                  /**<[in] output stream */
+) {
+    ctimer_scope_thread_t const * th;
+    long                          n = 0;
+
+    fprintf(out, "# ctimer profile 1\n");
+    for (th = __atomic_load_n(&_ctimer_scope_threads, __ATOMIC_ACQUIRE);
+         th != NULL; th = th->next) {
+        /* iterative pre-order traversal */
+        ctimer_scope_node_t const * c = th->root.child;
+        while (c != NULL) {
+            if (c->count > 0) {
+                _ctimer_scope_put_path(out, c);
+                fprintf(out, "\t%lu\t%ld\t%ld\n", c->count, c->incl,
+                        c->incl - c->inner);
+                ++n;
+            }
+            if (c->child != NULL)
+                c = c->child;
+            else {
+                while ((c != NULL) && (c->sibling == NULL))
+                    c = (c->parent != &th->root) ? c->parent : NULL;
+                if (c != NULL)
+                    c = c->sibling;
+            }
+        }
+    }
+    return n;
+}
+
+
+/**
+ * Write the call trees of all threads to file `path` (see
+ * `ctimer_scope_dump()`).
+ *
+ * @return 0 on success, or -1 if the file cannot be written
+ */
+static inline
+int ctimer_scope_dump_file(
+    char const * path           /**<[in] output file path */
+) {
+    FILE * out = fopen(path, "w");
+    if (out == NULL)
+        return -1;
+    ctimer_scope_dump(out);
+    return (fclose(out) == 0) ? 0 : -1;
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_scope */
+
+
+#endif  /* __H_CTIMER_SCOPE__ */
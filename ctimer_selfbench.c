@@ -0,0 +1,175 @@
+/* -*- c -*- */
+
+/**
+ * CTimer self-benchmark: overhead of stopwatch operations, and of trace and
+ * histogram recording with each buffer backing.
+ *
+ * Build and run with:
+ * ```
+ * gcc -O2 -std=gnu99 ctimer_selfbench.c -o ctimer_selfbench
+ * ./ctimer_selfbench [trace-MiB]
+ * ```
+ *
+ * @file        ctimer_selfbench.c
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ctimer.h"
+#include "ctimer_buf.h"
+#include "ctimer_trace.h"
+#include "ctimer_hist.h"
+
+
+/* buffer configurations compared by the benchmark */
+static struct {
+    char const * name;
+    int          flags;
+} const configs[] = {
+    {"small, lazy",     CTIMER_BUF_NO_HUGE | CTIMER_BUF_NO_PREFAULT},
+    {"small, prefault", CTIMER_BUF_NO_HUGE},
+    {"thp, prefault",   CTIMER_BUF_NO_HUGETLB},
+    {"hugetlb, prefault", 0}
+};
+
+
+/* nsec per iteration of the stopwatch operations */
+static void bench_stopwatch(long const n) {
+    ctimer_t t, run;
+    long     i;
+
+    printf("clock read          : %ld nsec\n", ctimer_calibrate(100000));
+
+    ctimer_reset(&t);
+    ctimer_start(&run);
+    for (i = 0; i < n; ++i) {
+        ctimer_start(&t);
+        ctimer_stop(&t);
+        ctimer_lap(&t);
+    }
+    ctimer_stop(&run);
+    ctimer_measure(&run);
+    printf("start+stop+lap      : %.1f nsec\n",
+           (double)timespec_nsec(run.elapsed) / (double)n);
+
+    ctimer_reset(&t);
+    ctimer_start(&run);
+    for (i = 0; i < n; ++i) {
+        ctimer_resume(&t);
+        ctimer_pause(&t);
+    }
+    ctimer_stop(&run);
+    ctimer_measure(&run);
+    printf("resume+pause        : %.1f nsec\n",
+           (double)timespec_nsec(run.elapsed) / (double)n);
+}
+
+
+/* setup time and nsec per appended event for one buffer configuration */
+static void bench_trace(char const * name, int const flags, size_t const bytes) {
+    size_t const   nev = bytes / sizeof(ctimer_event_t);
+    ctimer_trace_t tr;
+    ctimer_t       setup, first, steady;
+    size_t         i;
+
+    ctimer_start(&setup);
+    if (ctimer_trace_init(&tr, nev, flags) != 0) {
+        printf("trace %-18s: allocation failed\n", name);
+        return;
+    }
+    ctimer_stop(&setup);
+    ctimer_measure(&setup);
+
+    ctimer_start(&first);
+    for (i = 0; i < nev; ++i)
+        ctimer_trace_append(&tr, CTIMER_EVENT_MARK, (unsigned)i, (long)i);
+    ctimer_stop(&first);
+    ctimer_measure(&first);
+
+    ctimer_start(&steady);
+    for (i = 0; i < nev; ++i)
+        ctimer_trace_append(&tr, CTIMER_EVENT_MARK, (unsigned)i, (long)i);
+    ctimer_stop(&steady);
+    ctimer_measure(&steady);
+
+    printf("trace %-18s: backing %-7s setup %8.3f msec,"
+           " first pass %.2f nsec/event, steady %.2f nsec/event\n",
+           name, ctimer_buf_backing_name(tr.buf.backing),
+           timespec_sec(setup.elapsed) * 1e3,
+           (double)timespec_nsec(first.elapsed) / (double)nev,
+           (double)timespec_nsec(steady.elapsed) / (double)nev);
+    ctimer_trace_destroy(&tr);
+}
+
+
+/* nsec per histogram sample for one buffer configuration */
+static void bench_hist(char const * name, int const flags, long const n) {
+    ctimer_hist_t h;
+    ctimer_t      run;
+    unsigned long x = 88172645463325252UL;
+    long          i;
+
+    if (ctimer_hist_init(&h, flags) != 0) {
+        printf("hist  %-18s: allocation failed\n", name);
+        return;
+    }
+    ctimer_start(&run);
+    for (i = 0; i < n; ++i) {
+        x ^= x << 13;           /* xorshift64: spread samples over buckets */
+        x ^= x >> 7;
+        x ^= x << 17;
+        ctimer_hist_record(&h, (long)(x >> (22 + (x & 15))));
+    }
+    ctimer_stop(&run);
+    ctimer_measure(&run);
+    printf("hist  %-18s: backing %-7s %.2f nsec/sample\n",
+           name, ctimer_buf_backing_name(h.buf.backing),
+           (double)timespec_nsec(run.elapsed) / (double)n);
+    ctimer_hist_destroy(&h);
+}
+
+
+int main(int argc, char ** argv) {
+    long const   mib   = (argc > 1) ? atol(argv[1]) : 64;
+    size_t const bytes = (size_t)(mib > 0 ? mib : 64) << 20;
+    size_t       i;
+
+    bench_stopwatch(1000000);
+    printf("\n");
+    for (i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i)
+        bench_trace(configs[i].name, configs[i].flags, bytes);
+    printf("\n");
+    for (i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i)
+        bench_hist(configs[i].name, configs[i].flags, 10000000);
+    return 0;
+}
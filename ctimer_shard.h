@@ -0,0 +1,387 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * NUMA-aware per-thread shards of CTimer lap statistics.
+ *
+ * @file        ctimer_shard.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_SHARD__
+#define __H_CTIMER_SHARD__
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "ctimer.h"
+
+
+/**
+ * @defgroup ctimer_shard Sharded statistics API
+ * @ingroup ctimer
+ *
+ * Per-thread lap statistics allocated on the thread's local NUMA node, with
+ * per-node aggregation.
+ *
+ * A `ctimer_shards_t` registry holds `nslots` lap-statistics slots (one per
+ * instrumented section) for every attached thread.  `ctimer_shards_attach()`
+ * maps a fresh shard for the calling thread, binds it to the thread's current
+ * NUMA node with `mbind(MPOL_PREFERRED)` where supported, and first-touches it
+ * from the calling thread, so the shard is node-local even without `mbind`.
+ * Threads should be pinned before attaching.
+ *
+ * Each shard has a single writer, which updates it with relaxed stores and no
+ * atomic read-modify-write instructions.  Aggregation is done per node
+ * (`ctimer_shards_aggregate_node()`, ideally run from a thread on that node so
+ * that only the per-node partials cross sockets), and per-node partials are
+ * then merged into totals.  `ctimer_shards_print()` reports per-node breakdowns
+ * as well as totals, which exposes NUMA-skewed latency.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Maximum number of shards (threads) per registry.  May be overridden. */
+#ifndef CTIMER_SHARD_MAX_THREADS
+#define CTIMER_SHARD_MAX_THREADS 1024
+#endif
+
+/** Maximum number of NUMA nodes.  May be overridden. */
+#ifndef CTIMER_SHARD_MAX_NODES
+#define CTIMER_SHARD_MAX_NODES 64
+#endif
+
+
+/**
+ * Per-thread shard of lap statistics slots.
+ */
+typedef struct {
+    int              node;      /**< NUMA node of the owning thread */
+    int              cpu;       /**< CPU of the owning thread at attach time */
+    int              nslots;    /**< Number of slots */
+    size_t           bytes;     /**< Size of the shard mapping */
+    ctimer_stats_t * slot;      /**< Lap statistics slots */
+} ctimer_shard_t;
+
+
+/**
+ * Registry of per-thread shards.
+ */
+typedef struct {
+    int              nslots;    /**< Slots per shard */
+    int              nshards;   /**< Number of attached shards */
+    ctimer_shard_t * shard[CTIMER_SHARD_MAX_THREADS]; /**< Attached shards */
+} ctimer_shards_t;
+
+
+/* MPOL_PREFERRED from <linux/mempolicy.h> */
+enum { _CTIMER_MPOL_PREFERRED = 1 };
+
+
+/**
+ * Initialize an empty shard registry with `nslots` slots per shard.
+ */
+static inline
+void ctimer_shards_init(
+    ctimer_shards_t * reg,      /**<[out] shard registry */
+    int const         nslots    /**<[in]  slots per shard */
+) {
+    memset(reg, 0, sizeof(*reg));
+    reg->nslots = nslots;
+}
+
+
+/* CPU and NUMA node of the calling thread */
+static inline
+void _ctimer_shard_getcpu(
+    int * cpu,
+    int * node
+) {
+    unsigned c = 0;
+    unsigned n = 0;
+#ifdef SYS_getcpu
+    if (syscall(SYS_getcpu, &c, &n, NULL) != 0)
+        c = n = 0;
+#endif
+    *cpu  = (int)c;
+    *node = (int)n;
+}
+
+
+/**
+ * Allocate a shard for the calling thread on its local NUMA node and attach it
+ * to the registry.  The calling thread becomes the shard's only writer.
+ *
+ * @return the new shard, or `NULL` if the registry is full or allocation
+ * fails
+ *
+ * @sa ctimer_shard_add
+ */
+static inline
+ctimer_shard_t * ctimer_shards_attach(
+    ctimer_shards_t * reg       /**<[in,out] shard registry */
+) {
+    long const       page  = sysconf(_SC_PAGESIZE);
+    size_t const     need  = sizeof(ctimer_shard_t)
+                           + (size_t)reg->nslots * sizeof(ctimer_stats_t);
+    size_t const     bytes = (need + (size_t)page - 1) / (size_t)page
+                           * (size_t)page;
+    ctimer_shard_t * sh;
+    void           * mem;
+    int              cpu, node, idx, i;
+
+    if (__atomic_load_n(&reg->nshards, __ATOMIC_RELAXED)
+        >= CTIMER_SHARD_MAX_THREADS)
+        return NULL;
+    mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+
+    _ctimer_shard_getcpu(&cpu, &node);
+#ifdef SYS_mbind
+    if ((node >= 0) && (node < CTIMER_SHARD_MAX_NODES)) {
+        unsigned long mask[CTIMER_SHARD_MAX_NODES / (8 * sizeof(long)) + 1];
+        memset(mask, 0, sizeof(mask));
+        mask[node / (8 * sizeof(long))] = 1UL << (node % (8 * sizeof(long)));
+        /* best effort; first touch below places pages locally regardless */
+        (void)syscall(SYS_mbind, mem, bytes, _CTIMER_MPOL_PREFERRED, mask,
+                      (unsigned long)(8 * sizeof(mask)), 0);
+    }
+#endif
+    memset(mem, 0, bytes);      /* first touch from the owning thread */
+
+    sh = (ctimer_shard_t *)mem;
+    sh->node   = node;
+    sh->cpu    = cpu;
+    sh->nslots = reg->nslots;
+    sh->bytes  = bytes;
+    sh->slot   = (ctimer_stats_t *)(sh + 1);
+    for (i = 0; i < sh->nslots; ++i)
+        ctimer_stats_reset(&sh->slot[i]);
+
+    idx = __atomic_fetch_add(&reg->nshards, 1, __ATOMIC_RELAXED);
+    if (idx >= CTIMER_SHARD_MAX_THREADS) {
+        munmap(mem, bytes);
+        return NULL;
+    }
+    __atomic_store_n(&reg->shard[idx], sh, __ATOMIC_RELEASE);
+    return sh;
+}
+
+
+/**
+ * Release all shards of a registry.  No thread may use its shard afterwards.
+ */
+static inline
+void ctimer_shards_destroy(
+    ctimer_shards_t * reg       /**<[in,out] shard registry */
+) {
+    int n = reg->nshards;
+    int i;
+    if (n > CTIMER_SHARD_MAX_THREADS)
+        n = CTIMER_SHARD_MAX_THREADS;
+    for (i = 0; i < n; ++i)
+        if (reg->shard[i] != NULL)
+            munmap(reg->shard[i], reg->shard[i]->bytes);
+    reg->nshards = 0;
+}
+
+
+/**
+ * Add one lap of `ns` nsec to slot `i` of the calling thread's shard.  Uses
+ * plain loads and relaxed stores, which is safe because the owning thread is
+ * the only writer.
+ */
+static inline
+void ctimer_shard_add(
+    ctimer_shard_t * sh,        /**<[in,out] calling thread's shard */
+    int const        i,         /**<[in]     slot index */
+    long const       ns         /**<[in]     lap duration (nsec) */
+) {
+    ctimer_stats_t * s = &sh->slot[i];
+    __atomic_store_n(&s->count, s->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->sum,   s->sum + ns,  __ATOMIC_RELAXED);
+    if ((s->min < 0) || (ns < s->min))
+        __atomic_store_n(&s->min, ns, __ATOMIC_RELAXED);
+    if (ns > s->max)
+        __atomic_store_n(&s->max, ns, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Add the `start`-to-`end` duration of a stopped `ctimer_t` stopwatch to slot
+ * `i` of the calling thread's shard.
+ */
+static inline
+void ctimer_shard_lap(
+    ctimer_shard_t       * sh,  /**<[in,out] calling thread's shard */
+    int            const   i,   /**<[in]     slot index */
+    ctimer_t       const * t    /**<[in]     stopped stopwatch */
+) {
+    ctimer_shard_add(sh, i, timespec_nsec(t->end) - timespec_nsec(t->start));
+}
+
+
+/* merge a concurrently updated slot into a local aggregate */
+static inline
+void _ctimer_shard_merge_slot(
+    ctimer_stats_t       * dst,
+    ctimer_stats_t const * src
+) {
+    ctimer_stats_t const snap = ctimer_stats_load(src);
+    ctimer_stats_merge(dst, &snap);
+}
+
+
+/**
+ * Aggregate all slots of the shards on NUMA node `node` into `out[0:nslots]`.
+ * Run from a thread on `node` to keep shard reads node-local.
+ *
+ * @return number of shards on `node`
+ */
+static inline
+int ctimer_shards_aggregate_node(
+    ctimer_shards_t const * reg,  /**<[in]  shard registry */
+    int             const   node, /**<[in]  NUMA node */
+    ctimer_stats_t        * out   /**<[out] per-slot node aggregates */
+) {
+    int n = __atomic_load_n(&reg->nshards, __ATOMIC_RELAXED);
+    int found = 0;
+    int i, k;
+
+    if (n > CTIMER_SHARD_MAX_THREADS)
+        n = CTIMER_SHARD_MAX_THREADS;
+    for (k = 0; k < reg->nslots; ++k)
+        ctimer_stats_reset(&out[k]);
+    for (i = 0; i < n; ++i) {
+        ctimer_shard_t const * sh =
+            __atomic_load_n(&reg->shard[i], __ATOMIC_ACQUIRE);
+        if ((sh == NULL) || (sh->node != node))
+            continue;
+        for (k = 0; k < reg->nslots; ++k)
+            _ctimer_shard_merge_slot(&out[k], &sh->slot[k]);
+        found++;
+    }
+    return found;
+}
+
+
+/**
+ * Aggregate slot `slot` per NUMA node into `per_node[0:max_nodes]`, and return
+ * the number of nodes (one past the highest node id with attached shards).
+ */
+static inline
+int ctimer_shards_nodes(
+    ctimer_shards_t const * reg,       /**<[in]  shard registry */
+    int             const   slot,      /**<[in]  slot index */
+    ctimer_stats_t        * per_node,  /**<[out] per-node aggregates */
+    int             const   max_nodes  /**<[in]  capacity of `per_node` */
+) {
+    int n = __atomic_load_n(&reg->nshards, __ATOMIC_RELAXED);
+    int nnodes = 0;
+    int i;
+
+    if (n > CTIMER_SHARD_MAX_THREADS)
+        n = CTIMER_SHARD_MAX_THREADS;
+    for (i = 0; i < max_nodes; ++i)
+        ctimer_stats_reset(&per_node[i]);
+    for (i = 0; i < n; ++i) {
+        ctimer_shard_t const * sh =
+            __atomic_load_n(&reg->shard[i], __ATOMIC_ACQUIRE);
+        if ((sh == NULL) || (sh->node < 0) || (sh->node >= max_nodes))
+            continue;
+        _ctimer_shard_merge_slot(&per_node[sh->node], &sh->slot[slot]);
+        if (sh->node + 1 > nnodes)
+            nnodes = sh->node + 1;
+    }
+    return nnodes;
+}
+
+
+/**
+ * Print the per-node breakdown and total of slot `slot` across all shards.
+ *
+ * Lines are printed as:
+ * ```
+ * Time(<label>) = XX.XXXXXXXXX sec [N laps; min/mean/max = A/B/C nsec]
+ * Time(<label>@node<K>) = XX.XXXXXXXXX sec [N laps; ...]
+ * ```
+ *
+ * @sa ctimer_stats_print
+ */
+static inline
+void ctimer_shards_print(
+    ctimer_shards_t const * reg,   /**<[in] shard registry */
+    int             const   slot,  /**<[in] slot index */
+    char            const * label  /**<[in] label/description */
+) {
+    ctimer_stats_t per_node[CTIMER_SHARD_MAX_NODES];
+    ctimer_stats_t total;
+    char           name[128];
+    int            nnodes;
+    int            k;
+
+    nnodes = ctimer_shards_nodes(reg, slot, per_node, CTIMER_SHARD_MAX_NODES);
+    ctimer_stats_reset(&total);
+    for (k = 0; k < nnodes; ++k)
+        ctimer_stats_merge(&total, &per_node[k]);
+    ctimer_stats_print(&total, label);
+    for (k = 0; k < nnodes; ++k) {
+        if (per_node[k].count == 0)
+            continue;
+        snprintf(name, sizeof(name), "%s@node%d",
+                 (label != NULL) ? label : "", k);
+        ctimer_stats_print(&per_node[k], name);
+    }
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_shard */
+
+
+#endif  /* __H_CTIMER_SHARD__ */
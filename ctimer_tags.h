@@ -0,0 +1,442 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Dimensional CTimer statistics keyed by label and tag tuple.
+ *
+ * @file        ctimer_tags.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_TAGS__
+#define __H_CTIMER_TAGS__
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ctimer.h"
+#include "ctimer_buf.h"
+
+
+/**
+ * @defgroup ctimer_tags Tagged statistics API
+ * @ingroup ctimer
+ *
+ * Lap statistics split by a label and a tuple of integer tags, e.g.
+ * `("rpc", {endpoint, status, shard})`.
+ *
+ * A `ctimer_tags_t` table maps each distinct (label, tags) key to a slot with
+ * `ctimer_stats_t` lap statistics.  Slots live in a fixed-capacity,
+ * open-addressing (linear probing) table that is never resized: lookups are
+ * lock-free, and a new key is claimed with a single compare-and-swap on its
+ * slot's hash word and published with a release store.  Slot statistics are
+ * updated with relaxed atomic operations, so any thread may record into any
+ * slot.  Slot pointers stay valid until the table is destroyed.
+ *
+ * The number of distinct keys is capped by the table's cardinality `limit`;
+ * once it is reached, lookups of new keys return the table's `overflow` slot,
+ * which aggregates all samples of rejected keys, and `rejected` counts such
+ * lookups (lookups answered by a call-site cache are not counted again).
+ * Memory use is therefore fixed at initialization.
+ *
+ * Tags are integers (e.g., status codes, shard numbers, or enumerated
+ * endpoint ids); string-valued dimensions should be mapped to small ids.
+ * Labels are compared by content, but the table keeps only the pointer, so
+ * they must outlive the table (e.g., string literals).
+ *
+ * `CTIMER_TAGS_SLOT()` caches the last key and slot of a call site in
+ * thread-local storage, so repeated lookups with identical tags compare a few
+ * words instead of hashing and probing:
+ * ```
+ * ctimer_stats_t * s = CTIMER_TAGS_SLOT(&tab, "rpc", endpoint, status, shard);
+ * ctimer_tags_lap(s, &t);
+ * ```
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Maximum number of tags per key.  May be overridden. */
+#ifndef CTIMER_TAGS_MAX
+#define CTIMER_TAGS_MAX 4
+#endif
+
+
+/* slot hash word states; key hashes are mapped above these */
+#define _CTIMER_TAGS_EMPTY 0UL
+#define _CTIMER_TAGS_BUSY  1UL
+
+
+/**
+ * Table slot: key and lap statistics.
+ */
+typedef struct {
+    ctimer_stats_t   stats;     /**< Lap statistics (atomically updated) */
+    unsigned long    hash;      /**< Key hash, or empty/busy marker */
+    char const     * label;     /**< Key label */
+    int              ntags;     /**< Number of key tags */
+    long             tags[CTIMER_TAGS_MAX]; /**< Key tags */
+} ctimer_tagslot_t;
+
+
+/**
+ * Tagged statistics table.
+ */
+typedef struct {
+    ctimer_tagslot_t * slot;     /**< Slots */
+    unsigned long      mask;     /**< Capacity - 1 (capacity is a power of 2) */
+    unsigned long      limit;    /**< Maximum number of distinct keys */
+    unsigned long      used;     /**< Distinct keys inserted */
+    unsigned long      rejected; /**< Lookups rejected by the limit */
+    ctimer_tagslot_t   overflow; /**< Statistics of rejected keys */
+    char const       * names[CTIMER_TAGS_MAX]; /**< Tag names (or NULL) */
+    ctimer_buf_t       buf;      /**< Backing buffer */
+} ctimer_tags_t;
+
+
+/**
+ * Per-call-site lookup cache.  Zero-initialize before first use.
+ *
+ * @sa CTIMER_TAGS_SLOT
+ */
+typedef struct {
+    ctimer_tags_t    const * table; /**< Table of the cached slot */
+    char             const * label; /**< Cached label (pointer) */
+    int                      ntags; /**< Number of cached tags */
+    long                     tags[CTIMER_TAGS_MAX]; /**< Cached tags */
+    ctimer_stats_t         * stats; /**< Cached slot statistics */
+} ctimer_tagcache_t;
+
+
+/**
+ * Allocate a tagged statistics table for up to `limit` distinct keys, with
+ * tag names `names[0..ntags)` used when printing (`names` may be NULL).  The
+ * table capacity is at least twice `limit`, to keep probe sequences short.
+ * `flags` are passed to `ctimer_buf_alloc()`.
+ *
+ * @return 0 on success, or -1 on allocation failure
+ *
+ * @sa ctimer_tags_destroy
+ */
+static inline
+int ctimer_tags_init(
+    ctimer_tags_t       * tab,   /**<[out] table */
+    unsigned long const   limit, /**<[in]  maximum number of distinct keys */
+    char const * const  * names, /**<[in]  tag names, or NULL */
+    int           const   ntags, /**<[in]  number of tag names */
+    int           const   flags  /**<[in]  `CTIMER_BUF_*` flags */
+) {
+    unsigned long cap = 2;
+    unsigned long i;
+    int           k;
+
+    while (cap < 2 * limit)
+        cap <<= 1;
+    memset(tab, 0, sizeof(*tab));
+    if (ctimer_buf_alloc(&tab->buf, cap * sizeof(ctimer_tagslot_t), flags)
+        != 0)
+        return -1;
+    tab->slot  = (ctimer_tagslot_t *)tab->buf.ptr;
+    tab->mask  = cap - 1;
+    tab->limit = limit;
+    for (i = 0; i < cap; ++i) {
+        ctimer_stats_reset(&tab->slot[i].stats);
+        tab->slot[i].hash = _CTIMER_TAGS_EMPTY;
+    }
+    ctimer_stats_reset(&tab->overflow.stats);
+    tab->overflow.label = "(overflow)";
+    for (k = 0; (names != NULL) && (k < ntags) && (k < CTIMER_TAGS_MAX); ++k)
+        tab->names[k] = names[k];
+    return 0;
+}
+
+
+/**
+ * Release the slots of a tagged statistics table.  All slot pointers become
+ * invalid.
+ */
+static inline
+void ctimer_tags_destroy(
+    ctimer_tags_t * tab         /**<[in,out] table */
+) {
+    ctimer_buf_free(&tab->buf);
+    tab->slot = NULL;
+}
+
+
+/* hash of a (label, tags) key; never one of the slot state markers */
+static inline
+unsigned long _ctimer_tags_hash(
+    char const * label,
+    long const * tags,
+    int  const   ntags
+) {
+    unsigned long h = 14695981039346656037UL; /* FNV-1a */
+    int           k;
+    for (; *label != '\0'; ++label)
+        h = (h ^ (unsigned char)*label) * 1099511628211UL;
+    for (k = 0; k < ntags; ++k) {
+        h ^= (unsigned long)tags[k] + 0x9e3779b97f4a7c15UL + (h << 6)
+             + (h >> 2);
+        h *= 0xbf58476d1ce4e5b9UL;
+    }
+    h ^= h >> 31;
+    return (h > _CTIMER_TAGS_BUSY) ? h : h + 2;
+}
+
+
+/* 1 if the published key of slot `s` equals (label, tags) */
+static inline
+int _ctimer_tags_equal(
+    ctimer_tagslot_t const * s,
+    char             const * label,
+    long             const * tags,
+    int              const   ntags
+) {
+    int k;
+    if (s->ntags != ntags)
+        return 0;
+    for (k = 0; k < ntags; ++k)
+        if (s->tags[k] != tags[k])
+            return 0;
+    return (s->label == label) || (strcmp(s->label, label) == 0);
+}
+
+
+/**
+ * Return the lap statistics of key (`label`, `tags[0..ntags)`), inserting the
+ * key if it is new.  Returns the overflow slot if the key is new and the
+ * table holds `limit` keys already.  Thread-safe and lock-free, except that a
+ * lookup of a key being inserted by another thread waits for that insertion
+ * to be published.
+ *
+ * @sa CTIMER_TAGS_SLOT
+ */
+static inline
+ctimer_stats_t * ctimer_tags_lookup(
+    ctimer_tags_t       * tab,   /**<[in,out] table */
+    char          const * label, /**<[in]     key label */
+    long          const * tags,  /**<[in]     key tags */
+    int                   ntags  /**<[in]     number of tags */
+) {
+    unsigned long const h = _ctimer_tags_hash(label, tags,
+                                              (ntags < CTIMER_TAGS_MAX)
+                                              ? ntags : CTIMER_TAGS_MAX);
+    unsigned long       i, probes;
+
+    if (ntags > CTIMER_TAGS_MAX)
+        ntags = CTIMER_TAGS_MAX;
+    for (i = h & tab->mask, probes = 0; probes <= tab->mask;
+         i = (i + 1) & tab->mask, ++probes) {
+        ctimer_tagslot_t * s = &tab->slot[i];
+        unsigned long      sh = __atomic_load_n(&s->hash, __ATOMIC_ACQUIRE);
+
+        while (sh == _CTIMER_TAGS_BUSY)    /* key being published */
+            sh = __atomic_load_n(&s->hash, __ATOMIC_ACQUIRE);
+        if (sh == h) {
+            if (_ctimer_tags_equal(s, label, tags, ntags))
+                return &s->stats;
+            continue;
+        }
+        if (sh != _CTIMER_TAGS_EMPTY)
+            continue;
+
+        /* empty slot: the key is new; claim the slot within the limit */
+        if (__atomic_fetch_add(&tab->used, 1, __ATOMIC_RELAXED)
+            >= tab->limit) {
+            __atomic_fetch_sub(&tab->used, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (!__atomic_compare_exchange_n(&s->hash, &sh, _CTIMER_TAGS_BUSY, 0,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            /* another key took the slot first; examine it again */
+            __atomic_fetch_sub(&tab->used, 1, __ATOMIC_RELAXED);
+            i = (i - 1) & tab->mask;
+            --probes;
+            continue;
+        }
+        s->label = label;
+        s->ntags = ntags;
+        memcpy(s->tags, tags, (size_t)ntags * sizeof(long));
+        __atomic_store_n(&s->hash, h, __ATOMIC_RELEASE);
+        return &s->stats;
+    }
+    __atomic_fetch_add(&tab->rejected, 1, __ATOMIC_RELAXED);
+    return &tab->overflow.stats;
+}
+
+
+/**
+ * Return the lap statistics of key (`label`, `tags[0..ntags)`), using and
+ * updating the lookup cache `c`: if the table, label pointer, and tags equal
+ * the cached ones, returns the cached slot without hashing.
+ *
+ * @sa CTIMER_TAGS_SLOT
+ */
+static inline
+ctimer_stats_t * ctimer_tags_lookup_cached(
+    ctimer_tagcache_t       * c,     /**<[in,out] call-site cache */
+    ctimer_tags_t           * tab,   /**<[in,out] table */
+    char              const * label, /**<[in]     key label */
+    long              const * tags,  /**<[in]     key tags */
+    int               const   ntags  /**<[in]     number of tags */
+) {
+    int k;
+    if ((c->stats != NULL) && (c->table == tab) && (c->label == label)
+        && (c->ntags == ntags)) {
+        for (k = 0; k < ntags; ++k)
+            if (c->tags[k] != tags[k])
+                break;
+        if (k == ntags)
+            return c->stats;
+    }
+    c->stats = ctimer_tags_lookup(tab, label, tags, ntags);
+    c->table = tab;
+    c->label = label;
+    c->ntags = (ntags < CTIMER_TAGS_MAX) ? ntags : CTIMER_TAGS_MAX;
+    memcpy(c->tags, tags, (size_t)c->ntags * sizeof(long));
+    return c->stats;
+}
+
+
+/**
+ * Look up the lap statistics of key (`label`, tags...) through a
+ * thread-local cache private to the call site.  Tags are given as integer
+ * arguments (at most `CTIMER_TAGS_MAX`, possibly none).
+ *
+ * @note Uses a GNU statement expression (GCC or Clang).
+ */
+#define CTIMER_TAGS_SLOT(tab, label, ...)                               \
+    __extension__ ({                                                    \
+        static __thread ctimer_tagcache_t _ctimer_tags_cache;           \
+        /* leading pad: the array is non-empty even without tags */     \
+        long const _ctimer_tags_key[] = {0, __VA_ARGS__};               \
+        ctimer_tags_lookup_cached(                                      \
+            &_ctimer_tags_cache, (tab), (label), _ctimer_tags_key + 1,  \
+            (int)(sizeof(_ctimer_tags_key) / sizeof(long)) - 1);        \
+    })
+
+
+/**
+ * Add one lap of duration `ns` nsec to slot statistics, using relaxed atomic
+ * operations (see `ctimer_stats_add_atomic()`).
+ */
+static inline
+void ctimer_tags_add(
+    ctimer_stats_t * s,         /**<[in,out] slot statistics */
+    long const       ns         /**<[in]     lap duration (nsec) */
+) {
+    ctimer_stats_add_atomic(s, ns);
+}
+
+
+/**
+ * Add the `start`-to-`end` duration of a stopped `ctimer_t` stopwatch to
+ * slot statistics.
+ */
+static inline
+void ctimer_tags_lap(
+    ctimer_stats_t       * s,   /**<[in,out] slot statistics */
+    ctimer_t       const * t    /**<[in]     stopped stopwatch */
+) {
+    ctimer_tags_add(s, timespec_nsec(t->end) - timespec_nsec(t->start));
+}
+
+
+/* print one slot as "label{name=tag,...}" statistics */
+static inline
+void _ctimer_tags_print_slot(
+    ctimer_tags_t    const * tab,
+    ctimer_tagslot_t const * s
+) {
+    char           buf[256];
+    int            n, k;
+    ctimer_stats_t snap;
+
+    n = snprintf(buf, sizeof(buf), "%s", s->label);
+    for (k = 0; (k < s->ntags) && (n < (int)sizeof(buf)); ++k) {
+        int const m = (tab->names[k] != NULL)
+            ? snprintf(buf + n, sizeof(buf) - (size_t)n, "%s%s=%ld",
+                       (k == 0) ? "{" : ",", tab->names[k], s->tags[k])
+            : snprintf(buf + n, sizeof(buf) - (size_t)n, "%s%ld",
+                       (k == 0) ? "{" : ",", s->tags[k]);
+        n += (m > 0) ? m : 0;
+    }
+    if ((s->ntags > 0) && (n < (int)sizeof(buf) - 1))
+        strcat(buf, "}");
+    snap = ctimer_stats_load(&s->stats);
+    ctimer_stats_print(&snap, buf);
+}
+
+
+/**
+ * Print the statistics of every key of a table, then of the overflow slot if
+ * any key was rejected, and a line with the table occupancy.
+ *
+ * Lines are printed as (see `ctimer_stats_print()`):
+ * ```
+ * Time(<label>{<name>=<tag>,...}) = XX.XXXXXXXXX sec [N laps; ...]
+ * Tags = K of LIMIT keys; R rejected lookups
+ * ```
+ */
+static inline
+void ctimer_tags_print(
+    ctimer_tags_t const * tab   /**<[in] table */
+) {
+    unsigned long i;
+    for (i = 0; i <= tab->mask; ++i)
+        if (__atomic_load_n(&tab->slot[i].hash, __ATOMIC_ACQUIRE)
+            > _CTIMER_TAGS_BUSY)
+            _ctimer_tags_print_slot(tab, &tab->slot[i]);
+    if (tab->rejected > 0)
+        _ctimer_tags_print_slot(tab, &tab->overflow);
+    printf("Tags = %lu of %lu keys; %lu rejected lookups\n",
+           __atomic_load_n(&tab->used, __ATOMIC_RELAXED), tab->limit,
+           __atomic_load_n(&tab->rejected, __ATOMIC_RELAXED));
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_tags */
+
+
+#endif  /* __H_CTIMER_TAGS__ */
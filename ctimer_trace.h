@@ -0,0 +1,266 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Per-thread event trace rings for CTimer stopwatches.
+ *
+ * @file        ctimer_trace.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_TRACE__
+#define __H_CTIMER_TRACE__
+
+
+#include <stdio.h>
+
+#include "ctimer.h"
+#include "ctimer_buf.h"
+
+
+/**
+ * @defgroup ctimer_trace Trace API
+ * @ingroup ctimer
+ *
+ * Fixed-size rings of timestamped stopwatch events.
+ *
+ * A `ctimer_trace_t` trace ring records start/stop/mark events (timestamp in
+ * nsec, user-chosen event id, and kind) for one writer thread.  When full, the
+ * ring overwrites its oldest events, so it always holds the most recent
+ * history ("flight recorder").  The ring lives in a `ctimer_buf_t` buffer,
+ * i.e., on huge pages where possible and prefaulted at setup.
+ *
+ * Other threads may take a consistent snapshot of the latest events with
+ * `ctimer_trace_snapshot()` while the writer keeps appending.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Trace event kinds.
+ */
+enum {
+    CTIMER_EVENT_START = 0,     /**< Stopwatch started */
+    CTIMER_EVENT_STOP  = 1,     /**< Stopwatch stopped */
+    CTIMER_EVENT_MARK  = 2      /**< Point event */
+};
+
+
+/**
+ * Trace event record (16 bytes).
+ */
+typedef struct {
+    long     ts;                /**< `CLOCK_MONOTONIC` timestamp (nsec) */
+    unsigned id;                /**< Event id */
+    unsigned kind;              /**< `CTIMER_EVENT_*` kind */
+} ctimer_event_t;
+
+
+/**
+ * Single-writer trace ring.
+ */
+typedef struct {
+    ctimer_event_t * ev;        /**< Event slots */
+    unsigned long    mask;      /**< Capacity - 1 (capacity is a power of 2) */
+    unsigned long    head;      /**< Number of events appended so far */
+    ctimer_buf_t     buf;       /**< Backing buffer */
+} ctimer_trace_t;
+
+
+/**
+ * Allocate a trace ring with capacity for at least `nevents` events (rounded
+ * up to a power of 2).  `flags` are passed to `ctimer_buf_alloc()`.
+ *
+ * @return 0 on success, or -1 on allocation failure
+ *
+ * @sa ctimer_trace_destroy
+ */
+static inline
+int ctimer_trace_init(
+    ctimer_trace_t * tr,        /**<[out] trace ring */
+    size_t const     nevents,   /**<[in]  minimum capacity (events) */
+    int const        flags      /**<[in]  `CTIMER_BUF_*` flags */
+) {
+    size_t cap = 1;
+    while (cap < nevents)
+        cap <<= 1;
+    tr->head = 0;
+    if (ctimer_buf_alloc(&tr->buf, cap * sizeof(ctimer_event_t), flags) != 0)
+        return -1;
+    tr->ev   = (ctimer_event_t *)tr->buf.ptr;
+    tr->mask = cap - 1;
+    return 0;
+}
+
+
+/**
+ * Release the buffer of a trace ring.
+ */
+static inline
+void ctimer_trace_destroy(
+    ctimer_trace_t * tr         /**<[in,out] trace ring */
+) {
+    ctimer_buf_free(&tr->buf);
+    tr->ev = NULL;
+}
+
+
+/**
+ * Append one event to a trace ring.  Must only be called by the ring's writer
+ * thread.
+ */
+static inline
+void ctimer_trace_append(
+    ctimer_trace_t * tr,        /**<[in,out] trace ring */
+    unsigned const   kind,      /**<[in]     `CTIMER_EVENT_*` kind */
+    unsigned const   id,        /**<[in]     event id */
+    long const       ts         /**<[in]     timestamp (nsec) */
+) {
+    unsigned long const h = tr->head;
+    ctimer_event_t    * e = &tr->ev[h & tr->mask];
+    /* order the previous head store before the slot overwrite, so that a
+     * reader that sees the overwrite also sees the head that accounts for it */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->ts   = ts;
+    e->id   = id;
+    e->kind = kind;
+    __atomic_store_n(&tr->head, h + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Start a `ctimer_t` stopwatch and record a `CTIMER_EVENT_START` event with
+ * its start time.
+ */
+static inline
+void ctimer_trace_start(
+    ctimer_trace_t * tr,        /**<[in,out] trace ring */
+    ctimer_t       * t,         /**<[in,out] stopwatch pointer */
+    unsigned const   id         /**<[in]     event id */
+) {
+    ctimer_start(t);
+    ctimer_trace_append(tr, CTIMER_EVENT_START, id, timespec_nsec(t->start));
+}
+
+
+/**
+ * Stop a `ctimer_t` stopwatch and record a `CTIMER_EVENT_STOP` event with its
+ * end time.
+ */
+static inline
+void ctimer_trace_stop(
+    ctimer_trace_t * tr,        /**<[in,out] trace ring */
+    ctimer_t       * t,         /**<[in,out] stopwatch pointer */
+    unsigned const   id         /**<[in]     event id */
+) {
+    ctimer_stop(t);
+    ctimer_trace_append(tr, CTIMER_EVENT_STOP, id, timespec_nsec(t->end));
+}
+
+
+/**
+ * Copy up to `max` of the most recent events of a trace ring to `out`, oldest
+ * first.  Safe to call from any thread while the writer keeps appending;
+ * events overwritten during the copy are dropped from the snapshot.
+ *
+ * @return number of events copied
+ */
+static inline
+size_t ctimer_trace_snapshot(
+    ctimer_trace_t const * tr,  /**<[in]  trace ring */
+    ctimer_event_t       * out, /**<[out] events, oldest first */
+    size_t         const   max  /**<[in]  capacity of `out` */
+) {
+    unsigned long const cap  = tr->mask + 1;
+    unsigned long const h0   = __atomic_load_n(&tr->head, __ATOMIC_ACQUIRE);
+    unsigned long       n    = (h0 < cap) ? h0 : cap;
+    unsigned long       from, h1, skip, i;
+
+    if (n > max)
+        n = max;
+    from = h0 - n;
+    for (i = 0; i < n; ++i)
+        out[i] = tr->ev[(from + i) & tr->mask];
+
+    /* events before h1 + 1 - cap may have been overwritten while copying
+     * (the writer may be storing event h1 already) */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    h1   = __atomic_load_n(&tr->head, __ATOMIC_RELAXED);
+    skip = (h1 + 1 > from + cap) ? h1 + 1 - cap - from : 0;
+    if (skip >= n)
+        return 0;
+    if (skip > 0)
+        for (i = skip; i < n; ++i)
+            out[i - skip] = out[i];
+    return n - skip;
+}
+
+
+/**
+ * Print events, one per line, with timestamps relative to the first event.
+ *
+ * Lines are printed as:
+ * ```
+ * Event(<kind>, <id>) = +XX.XXXXXXXXX sec
+ * ```
+ */
+static inline
+void ctimer_trace_print(
+    ctimer_event_t const * ev,  /**<[in] events */
+    size_t         const   n    /**<[in] number of events */
+) {
+    static char const * const kinds[] = {"start", "stop", "mark"};
+    size_t                    i;
+    for (i = 0; i < n; ++i) {
+        long const d = ev[i].ts - ev[0].ts;
+        printf("Event(%s, %u) = +%ld.%09ld sec\n",
+               (ev[i].kind <= CTIMER_EVENT_MARK) ? kinds[ev[i].kind] : "?",
+               ev[i].id, d / _NSEC_PER_SEC, d % _NSEC_PER_SEC);
+    }
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_trace */
+
+
+#endif  /* __H_CTIMER_TRACE__ */
@@ -0,0 +1,628 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * Asynchronous, double-buffered writer for CTimer trace events using io_uring.
+ *
+ * @file        ctimer_tracewriter.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_TRACEWRITER__
+#define __H_CTIMER_TRACEWRITER__
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(IORING_OFF_SQ_RING) && defined(__NR_io_uring_setup)
+#define _CTIMER_HAVE_IO_URING 1
+#else
+#define _CTIMER_HAVE_IO_URING 0
+#endif
+
+#include "ctimer.h"
+#include "ctimer_buf.h"
+#include "ctimer_trace.h"
+
+
+/**
+ * @defgroup ctimer_tracewriter Trace writer API
+ * @ingroup ctimer
+ *
+ * Streaming of trace events to a file without blocking the recording thread.
+ *
+ * A `ctimer_tracewriter_t` trace writer owns two event buffers.  The recording
+ * thread appends `ctimer_event_t` records to the active buffer; when it fills
+ * up, the buffer is handed off for writing and recording continues in the
+ * other buffer.  If the other buffer is still being written, events are
+ * dropped (and counted) rather than blocking the recording thread.
+ *
+ * Hand-off uses io_uring where available: both buffers are registered with
+ * the ring, filled buffers are submitted as `IORING_OP_WRITE_FIXED` requests,
+ * and completions are reaped without blocking on the next hand-off.  When
+ * io_uring is unavailable (old kernels, seccomp-restricted containers), a
+ * background thread writes filled buffers with `pwrite()`, woken by a
+ * semaphore post.
+ *
+ * The output file is a raw array of `ctimer_event_t` records.  Each writer
+ * must have a single recording thread and its own output file.
+ *
+ * @note Programs using the trace writer must be compiled with `-pthread`.
+ *
+ * @{
+ */
+
+
+/* prevent C++ compilers from mangling function names */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Trace writer back-ends.
+ */
+enum {
+    CTIMER_TW_IO_URING = 1,     /**< io_uring submissions */
+    CTIMER_TW_THREAD   = 2      /**< Background `pwrite()` thread */
+};
+
+
+/**
+ * Trace writer flags.
+ */
+enum {
+    CTIMER_TW_NO_IO_URING = 1 << 8 /**< Always use the `pwrite()` thread */
+};
+
+
+/**
+ * Double-buffered trace writer.
+ */
+typedef struct {
+    int              fd;        /**< Output file descriptor */
+    int              mode;      /**< `CTIMER_TW_*` back-end */
+    ctimer_buf_t     buf[2];    /**< Event buffers */
+    size_t           cap;       /**< Buffer capacity (events) */
+    size_t           pos;       /**< Events in the active buffer */
+    int              active;    /**< Active buffer index */
+    int              busy[2];   /**< Nonzero while a buffer is in flight */
+    size_t           len[2];    /**< Bytes in flight per buffer */
+    long             boff[2];   /**< File offset per buffer in flight */
+    long             off;       /**< Next output file offset */
+    unsigned long    written;   /**< Events written to the file */
+    unsigned long    dropped;   /**< Events dropped (buffers busy or I/O error) */
+    unsigned long    errors;    /**< Failed or short writes */
+    struct timespec  opened;    /**< Time the writer was opened */
+
+    /* io_uring state */
+    int              ring_fd;
+    int              fixed;     /* buffers registered */
+    void           * sq_map;
+    size_t           sq_map_len;
+    void           * cq_map;
+    size_t           cq_map_len;
+    void           * sqe_map;
+    size_t           sqe_map_len;
+    unsigned       * sq_tail;
+    unsigned       * sq_mask;
+    unsigned       * sq_array;
+    unsigned       * cq_head;
+    unsigned       * cq_tail;
+    unsigned       * cq_mask;
+    void           * sqes;
+    void           * cqes;
+    struct iovec     iov[2];    /* buffers, for registration or writev */
+
+    /* pwrite() thread state */
+    pthread_t        thread;
+    sem_t            sem;
+    int              stop;
+} ctimer_tracewriter_t;
+
+
+/* account for a completed write of buffer i with result res */
+static inline
+void _ctimer_tw_complete(
+    ctimer_tracewriter_t * w,
+    int const              i,
+    long const             res
+) {
+    unsigned long const nev = w->len[i] / sizeof(ctimer_event_t);
+    if (res == (long)w->len[i]) {
+        __atomic_fetch_add(&w->written, nev, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&w->errors, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&w->dropped, nev, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&w->busy[i], 0, __ATOMIC_RELEASE);
+}
+
+
+/* ==================================================
+ * PWRITE THREAD BACK-END
+ * ================================================== */
+
+
+static inline
+void * _ctimer_tw_thread_main(
+    void * arg
+) {
+    ctimer_tracewriter_t * w = (ctimer_tracewriter_t *)arg;
+    int                    i = 0; /* hand-offs alternate between buffers */
+    for (;;) {
+        size_t done = 0;
+        while (sem_wait(&w->sem) != 0)
+            ;
+        if (__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE))
+            return NULL;
+        while (done < w->len[i]) {
+            ssize_t const r = pwrite(w->fd, (char *)w->buf[i].ptr + done,
+                                     w->len[i] - done, w->boff[i] + (long)done);
+            if (r <= 0)
+                break;
+            done += (size_t)r;
+        }
+        _ctimer_tw_complete(w, i, (long)done);
+        i ^= 1;
+    }
+}
+
+
+/* ==================================================
+ * IO_URING BACK-END
+ * ================================================== */
+
+
+#if _CTIMER_HAVE_IO_URING
+
+/* set up a small ring and register both buffers; 0 on success */
+static inline
+int _ctimer_tw_uring_open(
+    ctimer_tracewriter_t * w
+) {
+    struct io_uring_params p;
+    char                 * sq;
+    char                 * cq;
+
+    memset(&p, 0, sizeof(p));
+    w->ring_fd = (int)syscall(__NR_io_uring_setup, 4, &p);
+    if (w->ring_fd < 0)
+        return -1;
+
+    w->sq_map_len  = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    w->cq_map_len  = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    w->sqe_map_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    w->sq_map  = mmap(NULL, w->sq_map_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, w->ring_fd, IORING_OFF_SQ_RING);
+    w->cq_map  = mmap(NULL, w->cq_map_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, w->ring_fd, IORING_OFF_CQ_RING);
+    w->sqe_map = mmap(NULL, w->sqe_map_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, w->ring_fd, IORING_OFF_SQES);
+    if ((w->sq_map == MAP_FAILED) || (w->cq_map == MAP_FAILED)
+        || (w->sqe_map == MAP_FAILED)) {
+        if (w->sq_map != MAP_FAILED)
+            munmap(w->sq_map, w->sq_map_len);
+        if (w->cq_map != MAP_FAILED)
+            munmap(w->cq_map, w->cq_map_len);
+        if (w->sqe_map != MAP_FAILED)
+            munmap(w->sqe_map, w->sqe_map_len);
+        close(w->ring_fd);
+        return -1;
+    }
+
+    sq = (char *)w->sq_map;
+    cq = (char *)w->cq_map;
+    w->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    w->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    w->sq_array = (unsigned *)(sq + p.sq_off.array);
+    w->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    w->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    w->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    w->cqes     = cq + p.cq_off.cqes;
+    w->sqes     = w->sqe_map;
+
+    /* registration may fail under RLIMIT_MEMLOCK; fall back to writev */
+    w->fixed = (syscall(__NR_io_uring_register, w->ring_fd,
+                        IORING_REGISTER_BUFFERS, w->iov, 2) == 0);
+    return 0;
+}
+
+
+static inline
+void _ctimer_tw_uring_close(
+    ctimer_tracewriter_t * w
+) {
+    munmap(w->sq_map, w->sq_map_len);
+    munmap(w->cq_map, w->cq_map_len);
+    munmap(w->sqe_map, w->sqe_map_len);
+    close(w->ring_fd);
+}
+
+
+/* reap completions without blocking */
+static inline
+void _ctimer_tw_uring_reap(
+    ctimer_tracewriter_t * w
+) {
+    struct io_uring_cqe const * cqes = (struct io_uring_cqe const *)w->cqes;
+    unsigned                    head = *w->cq_head;
+    unsigned const              tail = __atomic_load_n(w->cq_tail,
+                                                       __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe const * c = &cqes[head & *w->cq_mask];
+        _ctimer_tw_complete(w, (int)c->user_data, (long)c->res);
+        head++;
+    }
+    __atomic_store_n(w->cq_head, head, __ATOMIC_RELEASE);
+}
+
+
+/* submit buffer i for writing; 0 on success, or -1 if the write was not
+ * queued */
+static inline
+int _ctimer_tw_uring_submit(
+    ctimer_tracewriter_t * w,
+    int const              i
+) {
+    struct io_uring_sqe * sqes = (struct io_uring_sqe *)w->sqes;
+    unsigned const        tail = *w->sq_tail;
+    unsigned const        idx  = tail & *w->sq_mask;
+    struct io_uring_sqe * e    = &sqes[idx];
+    int                   tries;
+
+    memset(e, 0, sizeof(*e));
+    e->fd  = w->fd;
+    e->off = (unsigned long long)w->boff[i];
+    if (w->fixed) {
+        e->opcode    = IORING_OP_WRITE_FIXED;
+        e->addr      = (unsigned long long)(uintptr_t)w->buf[i].ptr;
+        e->len       = (unsigned)w->len[i];
+        e->buf_index = (unsigned short)i;
+    } else {
+        w->iov[i].iov_len = w->len[i];
+        e->opcode = IORING_OP_WRITEV;
+        e->addr   = (unsigned long long)(uintptr_t)&w->iov[i];
+        e->len    = 1;
+    }
+    e->user_data = (unsigned long long)i;
+    w->sq_array[idx] = idx;
+    __atomic_store_n(w->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    for (tries = 0; tries < 8; ++tries) {
+        long const r = syscall(__NR_io_uring_enter, w->ring_fd, 1, 0, 0,
+                               NULL, 0);
+        if (r == 1)
+            return 0;
+        if ((r < 0) && (errno != EINTR) && (errno != EAGAIN) &&
+            (errno != EBUSY))
+            break;
+        /* out of resources or completion space: make room and retry */
+        if ((r < 0) && (errno != EINTR))
+            _ctimer_tw_uring_reap(w);
+    }
+    /* without SQ polling, the kernel consumes entries only in a successful
+     * io_uring_enter(): withdraw the entry, so that it is not submitted
+     * later with the contents of the reused buffer */
+    __atomic_store_n(w->sq_tail, tail, __ATOMIC_RELEASE);
+    return -1;
+}
+
+
+/* block until at least one completion is available */
+static inline
+void _ctimer_tw_uring_wait(
+    ctimer_tracewriter_t * w
+) {
+    syscall(__NR_io_uring_enter, w->ring_fd, 0, 1, IORING_ENTER_GETEVENTS,
+            NULL, 0);
+    _ctimer_tw_uring_reap(w);
+}
+
+#endif  /* _CTIMER_HAVE_IO_URING */
+
+
+/* ==================================================
+ * TRACE WRITER API
+ * ================================================== */
+
+
+/* hand the active buffer off for writing and switch buffers; the other
+ * buffer must not be busy */
+static inline
+void _ctimer_tw_handoff(
+    ctimer_tracewriter_t * w
+) {
+    int const i = w->active;
+
+    if (w->pos == 0)
+        return;
+    w->len[i]  = w->pos * sizeof(ctimer_event_t);
+    w->boff[i] = w->off;
+    w->off    += (long)w->len[i];
+    __atomic_store_n(&w->busy[i], 1, __ATOMIC_RELAXED);
+#if _CTIMER_HAVE_IO_URING
+    if (w->mode == CTIMER_TW_IO_URING) {
+        if (_ctimer_tw_uring_submit(w, i) != 0)
+            _ctimer_tw_complete(w, i, -1);
+    } else
+#endif
+    {
+        sem_post(&w->sem);
+    }
+    w->active ^= 1;
+    w->pos     = 0;
+}
+
+
+/**
+ * Open a trace writer on file descriptor `fd`, with two buffers of at least
+ * `nevents` events each.  The low bits of `flags` are `CTIMER_BUF_*` flags
+ * for the buffers; `CTIMER_TW_NO_IO_URING` forces the `pwrite()` thread.
+ *
+ * @return the `CTIMER_TW_*` back-end in use, or -1 on failure
+ *
+ * @sa ctimer_tracewriter_close
+ */
+static inline
+int ctimer_tracewriter_open(
+    ctimer_tracewriter_t * w,       /**<[out] trace writer */
+    int const              fd,      /**<[in]  output file descriptor */
+    size_t const           nevents, /**<[in]  buffer capacity (events) */
+    int const              flags    /**<[in]  buffer and writer flags */
+) {
+    int i;
+
+    memset(w, 0, sizeof(*w));
+    w->fd  = fd;
+    w->cap = (nevents > 0) ? nevents : 1;
+    for (i = 0; i < 2; ++i) {
+        if (ctimer_buf_alloc(&w->buf[i], w->cap * sizeof(ctimer_event_t),
+                             flags & 0xff) != 0) {
+            ctimer_buf_free(&w->buf[0]);
+            return -1;
+        }
+        w->iov[i].iov_base = w->buf[i].ptr;
+        w->iov[i].iov_len  = w->buf[i].bytes;
+    }
+
+#if _CTIMER_HAVE_IO_URING
+    if (!(flags & CTIMER_TW_NO_IO_URING) && (_ctimer_tw_uring_open(w) == 0))
+        w->mode = CTIMER_TW_IO_URING;
+#endif
+    if (w->mode == 0) {
+        if ((sem_init(&w->sem, 0, 0) != 0)
+            || (pthread_create(&w->thread, NULL, _ctimer_tw_thread_main, w)
+                != 0)) {
+            ctimer_buf_free(&w->buf[0]);
+            ctimer_buf_free(&w->buf[1]);
+            return -1;
+        }
+        w->mode = CTIMER_TW_THREAD;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w->opened);
+    return w->mode;
+}
+
+
+/**
+ * Append one event to a trace writer.  Never blocks: if the active buffer is
+ * full and the other one is still being written, the event is dropped and
+ * counted in `dropped`.  Must only be called by the writer's recording
+ * thread.
+ */
+static inline
+void ctimer_tracewriter_append(
+    ctimer_tracewriter_t * w,    /**<[in,out] trace writer */
+    unsigned const         kind, /**<[in]     `CTIMER_EVENT_*` kind */
+    unsigned const         id,   /**<[in]     event id */
+    long const             ts    /**<[in]     timestamp (nsec) */
+) {
+    ctimer_event_t * e;
+
+    if (__builtin_expect(w->pos == w->cap, 0)) {
+        int const other = w->active ^ 1;
+#if _CTIMER_HAVE_IO_URING
+        if ((w->mode == CTIMER_TW_IO_URING)
+            && __atomic_load_n(&w->busy[other], __ATOMIC_ACQUIRE))
+            _ctimer_tw_uring_reap(w);
+#endif
+        if (__atomic_load_n(&w->busy[other], __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(&w->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        _ctimer_tw_handoff(w);
+    }
+    e = (ctimer_event_t *)w->buf[w->active].ptr + w->pos++;
+    e->ts   = ts;
+    e->id   = id;
+    e->kind = kind;
+}
+
+
+/**
+ * Start a `ctimer_t` stopwatch and append a `CTIMER_EVENT_START` event with
+ * its start time to a trace writer.
+ */
+static inline
+void ctimer_tracewriter_start(
+    ctimer_tracewriter_t * w,   /**<[in,out] trace writer */
+    ctimer_t             * t,   /**<[in,out] stopwatch pointer */
+    unsigned const         id   /**<[in]     event id */
+) {
+    ctimer_start(t);
+    ctimer_tracewriter_append(w, CTIMER_EVENT_START, id,
+                              timespec_nsec(t->start));
+}
+
+
+/**
+ * Stop a `ctimer_t` stopwatch and append a `CTIMER_EVENT_STOP` event with its
+ * end time to a trace writer.
+ */
+static inline
+void ctimer_tracewriter_stop(
+    ctimer_tracewriter_t * w,   /**<[in,out] trace writer */
+    ctimer_t             * t,   /**<[in,out] stopwatch pointer */
+    unsigned const         id   /**<[in]     event id */
+) {
+    ctimer_stop(t);
+    ctimer_tracewriter_append(w, CTIMER_EVENT_STOP, id, timespec_nsec(t->end));
+}
+
+
+/* block until no buffer is in flight */
+static inline
+void _ctimer_tw_drain(
+    ctimer_tracewriter_t * w
+) {
+    while (__atomic_load_n(&w->busy[0], __ATOMIC_ACQUIRE)
+           || __atomic_load_n(&w->busy[1], __ATOMIC_ACQUIRE)) {
+#if _CTIMER_HAVE_IO_URING
+        if (w->mode == CTIMER_TW_IO_URING) {
+            _ctimer_tw_uring_wait(w);
+            continue;
+        }
+#endif
+        {
+            struct timespec const nap = {0, 100 * 1000};
+            nanosleep(&nap, NULL);
+        }
+    }
+}
+
+
+/**
+ * Write out all buffered events and wait until they reach the file.  Blocks;
+ * call off the hot path (e.g., at phase boundaries or shutdown).
+ */
+static inline
+void ctimer_tracewriter_flush(
+    ctimer_tracewriter_t * w    /**<[in,out] trace writer */
+) {
+    _ctimer_tw_drain(w);
+    _ctimer_tw_handoff(w);
+    _ctimer_tw_drain(w);
+}
+
+
+/**
+ * Flush a trace writer and release its resources.  The output file
+ * descriptor is not closed.
+ */
+static inline
+void ctimer_tracewriter_close(
+    ctimer_tracewriter_t * w    /**<[in,out] trace writer */
+) {
+    ctimer_tracewriter_flush(w);
+#if _CTIMER_HAVE_IO_URING
+    if (w->mode == CTIMER_TW_IO_URING)
+        _ctimer_tw_uring_close(w);
+#endif
+    if (w->mode == CTIMER_TW_THREAD) {
+        __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+        sem_post(&w->sem);
+        pthread_join(w->thread, NULL);
+        sem_destroy(&w->sem);
+    }
+    ctimer_buf_free(&w->buf[0]);
+    ctimer_buf_free(&w->buf[1]);
+    w->mode = 0;
+}
+
+
+/**
+ * Return the write throughput of a trace writer since it was opened, in
+ * events per second.
+ */
+static inline
+double ctimer_tracewriter_rate(
+    ctimer_tracewriter_t const * w /**<[in] trace writer */
+) {
+    struct timespec now, d;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timespec_sub(&d, now, w->opened);
+    return (double)__atomic_load_n(&w->written, __ATOMIC_RELAXED)
+        / timespec_sec(d);
+}
+
+
+/**
+ * Print a line with the written and dropped event counts and write throughput
+ * of a trace writer.
+ *
+ * The line is printed as:
+ * ```
+ * Trace(<label>) = N events written, D dropped, R events/sec [<back-end>]
+ * ```
+ */
+static inline
+void ctimer_tracewriter_print(
+    ctimer_tracewriter_t const * w,     /**<[in] trace writer */
+    char                 const * label  /**<[in] label/description */
+) {
+    if ((label != NULL) && (label[0] != '\0'))
+        printf("Trace(%s) = ", label);
+    else
+        printf("Trace = ");
+    printf("%lu events written, %lu dropped, %.0f events/sec [%s]\n",
+           __atomic_load_n(&w->written, __ATOMIC_RELAXED),
+           __atomic_load_n(&w->dropped, __ATOMIC_RELAXED),
+           ctimer_tracewriter_rate(w),
+           (w->mode == CTIMER_TW_IO_URING)
+           ? (w->fixed ? "io_uring, registered buffers" : "io_uring")
+           : "pwrite thread");
+}
+
+
+#ifdef __cplusplus
+} /* end extern "C" */
+#endif
+
+
+/** @} */ /* end group ctimer_tracewriter */
+
+
+#endif  /* __H_CTIMER_TRACEWRITER__ */
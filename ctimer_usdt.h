@@ -0,0 +1,190 @@
+/* -*- c -*- */
+
+/**
+ * [Include-only header library]
+ * USDT static probes at CTimer stopwatch events.
+ *
+ * @file        ctimer_usdt.h
+ * @author      Alexandros-Stavros Iliopoulos
+ * @license     MIT
+ * @copyright   Copyright (c) 2021 Supertech Research Group, CSAIL, MIT
+ */
+
+
+/******************************************************************************/
+/* MIT License                                                                */
+/*                                                                            */
+/* Copyright (c) 2021 Supertech Research Group, CSAIL, MIT                    */
+/*                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining      */
+/* a copy of this software and associated documentation files (the            */
+/* "Software"), to deal in the Software without restriction, including        */
+/* without limitation the rights to use, copy, modify, merge, publish,        */
+/* distribute, sublicense, and/or sell copies of the Software, and to         */
+/* permit persons to whom the Software is furnished to do so, subject to      */
+/* the following conditions:                                                  */
+/*                                                                            */
+/* The above copyright notice and this permission notice shall be             */
+/* included in all copies or substantial portions of the Software.            */
+/*                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,            */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF         */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.     */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY       */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,       */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE          */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                     */
+
+
+#ifndef __H_CTIMER_USDT__
+#define __H_CTIMER_USDT__
+
+
+/**
+ * @defgroup ctimer_usdt USDT probe API
+ * @ingroup ctimer
+ *
+ * SystemTap-compatible user-level static probes for attaching bpftrace, perf,
+ * or SystemTap to stopwatch events.
+ *
+ * When `CTIMER_USDT` is defined before `ctimer.h` is included, the stopwatch
+ * functions contain probe points of provider `ctimer`:
+ *
+ * | Probe          | Fired by                | Arguments                  |
+ * |----------------|-------------------------|----------------------------|
+ * | `ctimer:start` | start, resume, start-at | id, start (nsec)           |
+ * | `ctimer:stop`  | stop, pause, stop-at    | id, end (nsec)             |
+ * | `ctimer:lap`   | lap, pause              | id, end (nsec), lap (nsec) |
+ *
+ * where `id` is the stopwatch address and timestamps are `CLOCK_MONOTONIC`.
+ * For example:
+ * ```
+ * bpftrace -e 'usdt:./prog:ctimer:lap { @[arg0] = hist(arg2); }'
+ * ```
+ *
+ * Each probe point is a single `nop` instruction, described by a
+ * `.note.stapsdt` ELF note (`readelf -n`) which tracers use to place a
+ * breakpoint on it; the notes are emitted by inline assembly in this header,
+ * without `sys/sdt.h`.  Probe arguments are still computed when no tracer is
+ * attached; if `CTIMER_USDT_SEMAPHORES` is also defined, each probe gets a
+ * semaphore which attached tracers increment, and argument setup is skipped
+ * while it is zero, at the cost of one load per event.
+ *
+ * Probes are emitted on x86-64 and AArch64 ELF targets with GCC or Clang;
+ * elsewhere, the probe macros expand to nothing.
+ *
+ * @note This header does not depend on `ctimer.h`, which includes it when
+ * `CTIMER_USDT` is defined.  It may also be used on its own to define custom
+ * `ctimer` probes with `CTIMER_USDT_PROBE2()` and `CTIMER_USDT_PROBE3()`.
+ *
+ * @{
+ */
+
+
+#if defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+#define CTIMER_USDT_SUPPORTED 1
+#else
+#define CTIMER_USDT_SUPPORTED 0
+#endif
+
+
+#if CTIMER_USDT_SUPPORTED
+
+
+#ifdef CTIMER_USDT_SEMAPHORES
+
+/**
+ * Define the semaphore of probe `ctimer:<name>`; weak, so all translation
+ * units share one.  Needed for custom probes when `CTIMER_USDT_SEMAPHORES` is
+ * defined.
+ */
+#define CTIMER_USDT_DEFINE_SEMAPHORE(name)                              \
+    __attribute__((weak, section(".probes")))                           \
+    volatile unsigned short ctimer_##name##_semaphore
+
+CTIMER_USDT_DEFINE_SEMAPHORE(start);
+CTIMER_USDT_DEFINE_SEMAPHORE(stop);
+CTIMER_USDT_DEFINE_SEMAPHORE(lap);
+
+/** Non-zero if a tracer is attached to probe `ctimer:<name>`. */
+#define CTIMER_USDT_ENABLED(name)                               \
+    __builtin_expect(ctimer_##name##_semaphore != 0, 0)
+
+#define _CTIMER_USDT_SEM(name) "ctimer_" #name "_semaphore"
+
+#else  /* no semaphores */
+
+#define CTIMER_USDT_DEFINE_SEMAPHORE(name)
+#define CTIMER_USDT_ENABLED(name) 1
+#define _CTIMER_USDT_SEM(name) "0"
+
+#endif  /* CTIMER_USDT_SEMAPHORES */
+
+
+/* probe point and its .note.stapsdt descriptor (version 3): probe address,
+ * link-time base address, semaphore address, provider, name, and argument
+ * specs; plus the comdat .stapsdt.base section, which tracers use to adjust
+ * addresses of prelinked binaries */
+#define _CTIMER_USDT_NOTE(name, args)                                   \
+    "990:   nop\n"                                                      \
+    "       .pushsection .note.stapsdt,\"?\",\"note\"\n"                \
+    "       .balign 4\n"                                                \
+    "       .4byte 992f-991f, 994f-993f, 3\n"                           \
+    "991:   .asciz \"stapsdt\"\n"                                       \
+    "992:   .balign 4\n"                                                \
+    "993:   .8byte 990b\n"                                              \
+    "       .8byte _.stapsdt.base\n"                                    \
+    "       .8byte " _CTIMER_USDT_SEM(name) "\n"                        \
+    "       .asciz \"ctimer\"\n"                                        \
+    "       .asciz \"" #name "\"\n"                                     \
+    "       .asciz \"" args "\"\n"                                      \
+    "994:   .balign 4\n"                                                \
+    "       .popsection\n"                                              \
+    "       .ifndef _.stapsdt.base\n"                                   \
+    "       .pushsection .stapsdt.base,\"aG\",\"progbits\","            \
+    ".stapsdt.base,comdat\n"                                            \
+    "       .weak _.stapsdt.base\n"                                     \
+    "       .hidden _.stapsdt.base\n"                                   \
+    "_.stapsdt.base: .space 1\n"                                        \
+    "       .size _.stapsdt.base, 1\n"                                  \
+    "       .popsection\n"                                              \
+    "       .endif\n"
+
+/**
+ * Probe point `ctimer:<name>` with two 64-bit signed integer arguments.
+ */
+#define CTIMER_USDT_PROBE2(name, x1, x2)                                \
+    do {                                                                \
+        if (CTIMER_USDT_ENABLED(name))                                  \
+            __asm__ __volatile__(                                       \
+                _CTIMER_USDT_NOTE(name, "-8@%[a1] -8@%[a2]")            \
+                : : [a1] "nor" ((long)(x1)), [a2] "nor" ((long)(x2))); \
+    } while (0)
+
+/**
+ * Probe point `ctimer:<name>` with three 64-bit signed integer arguments.
+ */
+#define CTIMER_USDT_PROBE3(name, x1, x2, x3)                            \
+    do {                                                                \
+        if (CTIMER_USDT_ENABLED(name))                                  \
+            __asm__ __volatile__(                                       \
+                _CTIMER_USDT_NOTE(name, "-8@%[a1] -8@%[a2] -8@%[a3]")   \
+                : : [a1] "nor" ((long)(x1)), [a2] "nor" ((long)(x2)),   \
+                  [a3] "nor" ((long)(x3)));                             \
+    } while (0)
+
+
+#else  /* !CTIMER_USDT_SUPPORTED */
+
+#define CTIMER_USDT_DEFINE_SEMAPHORE(name)
+#define CTIMER_USDT_ENABLED(name) 0
+#define CTIMER_USDT_PROBE2(name, x1, x2) ((void)0)
+#define CTIMER_USDT_PROBE3(name, x1, x2, x3) ((void)0)
+
+#endif  /* CTIMER_USDT_SUPPORTED */
+
+
+/** @} */ /* end group ctimer_usdt */
+
+
+#endif  /* __H_CTIMER_USDT__ */